@@ -1,10 +1,17 @@
 #pragma once
 
+#include "BandedAlignRow.h"
 #include "Cigar.h"
 #include "Common.h"
+#include "Simd.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
 typedef struct BandedAlignParams {
@@ -64,37 +71,142 @@ private:
       mScore      = MinInt();
       mIsTerminal = false;
     }
+
+    void Set( const int score, const bool terminal ) {
+      mScore      = score;
+      mIsTerminal = terminal;
+    }
   };
 
   using Scores = std::vector< int >;
-  using Gaps   = std::vector< Gap >;
-
-  void PrintRow( const size_t width ) {
-    for( int i = 0; i < width; i++ ) {
-      int score = mScores[ i ];
-      if( score <= MinInt() ) {
-        printf( "%5c", 'X' );
-      } else {
-        printf( "%5d", score );
-      }
+
+  // Scores (and ops) of aligning each position of A to a letter of B, by
+  // column, padded on both sides so any row of the band can index them.
+  // The buffers only grow, the padding is reset for every alignment.
+  struct Profile {
+    Scores   scores;
+    CigarOps ops;
+  };
+
+  // Column x of A is A[ startA + x - 1 ] forward, A[ startA - x ] in reverse
+  const Profile& ProfileOf( const char letter, const Sequence< Alphabet >& A,
+                            const size_t startA, const bool forward,
+                            const size_t reach ) {
+    int& index = mProfileOf[ ( unsigned char )letter ];
+    if( index >= 0 )
+      return mProfiles[ index ];
+
+    index = mProfileLetters.size();
+    mProfileLetters.push_back( letter );
+    if( mProfiles.size() < mProfileLetters.size() )
+      mProfiles.emplace_back();
+
+    Profile&     profile = mProfiles[ index ];
+    const size_t pad     = mParams.bandwidth + 1;
+    const size_t size    = pad + reach + 1 + BandedAlignRowPadding;
+    if( profile.scores.size() < size ) {
+      profile.scores.resize( size );
+      profile.ops.resize( size );
     }
-    printf( "\n" );
+
+    int*     scores = profile.scores.data();
+    CigarOp* ops    = profile.ops.data();
+    std::fill( scores, scores + pad + 1, 0 );
+    std::fill( ops, ops + pad + 1, CigarOp::Mismatch );
+    std::fill( scores + pad + reach + 1, scores + size, 0 );
+    std::fill( ops + pad + reach + 1, ops + size, CigarOp::Mismatch );
+    for( size_t x = 1; x <= reach; x++ ) {
+      char a = forward ? A[ startA + x - 1 ] : A[ startA - x ];
+
+      scores[ pad + x ] = ScorePolicy< Alphabet >::Score( a, letter );
+      ops[ pad + x ]    = MatchPolicy< Alphabet >::Match( a, letter )
+                            ? CigarOp::Match
+                            : CigarOp::Mismatch;
+    }
+
+    return profile;
+  }
+
+  void ClearProfiles() {
+    for( auto letter : mProfileLetters )
+      mProfileOf[ ( unsigned char )letter ] = -1;
+    mProfileLetters.clear();
   }
 
-  Scores            mScores;
-  Gaps              mVerticalGaps;
-  CigarOps          mOperations;
-  BandedAlignParams mParams;
+  // The traceback keeps 2 bits per op, four ops to a byte. Bits 0 and 2 of
+  // the op characters tell them apart.
+  static CigarOp OperationOfCode( const uint8_t code ) {
+    static const CigarOp ops[ 4 ] = { CigarOp::Mismatch, CigarOp::Insertion,
+                                      CigarOp::Deletion, CigarOp::Match };
+    return ops[ code ];
+  }
+
+  // Packs 4 * count ops into count bytes (a multiple of 4)
+  static void PackOperations( const CigarOp* ops, uint8_t* packed,
+                              const size_t count ) {
+#if defined( USE_X86_SIMD ) && defined( __SSE2__ )
+    // SSE2 comes with every x86-64 CPU, no need to check for it
+    const __m128i bit0 = _mm_set1_epi8( 1 ), bit1 = _mm_set1_epi8( 2 );
+    for( size_t i = 0; i < count; i += 4, ops += 16 ) {
+      __m128i v = _mm_loadu_si128( ( const __m128i* )ops );
+      __m128i c = _mm_or_si128( _mm_and_si128( v, bit0 ),
+                                _mm_and_si128( _mm_srli_epi16( v, 1 ), bit1 ) );
+      c = _mm_and_si128( _mm_or_si128( c, _mm_srli_epi16( c, 6 ) ),
+                         _mm_set1_epi16( 0x0F ) );
+      c = _mm_and_si128( _mm_or_si128( c, _mm_srli_epi32( c, 12 ) ),
+                         _mm_set1_epi32( 0xFF ) );
+      c = _mm_packs_epi32( c, c );
+      c = _mm_packus_epi16( c, c );
+
+      int bytes = _mm_cvtsi128_si32( c );
+      memcpy( packed + i, &bytes, sizeof( bytes ) );
+    }
+#else
+    const unsigned char* op = ( const unsigned char* )ops;
+    for( size_t i = 0; i < count; i++, op += 4 ) {
+      uint32_t w = uint32_t( op[ 0 ] ) | uint32_t( op[ 1 ] ) << 8 |
+                   uint32_t( op[ 2 ] ) << 16 | uint32_t( op[ 3 ] ) << 24;
+      w = ( w & 0x01010101 ) | ( ( w >> 1 ) & 0x02020202 );
+      packed[ i ] = uint8_t( w | w >> 6 | w >> 12 | w >> 18 );
+    }
+#endif
+  }
+
+  BandedAlignParams    mParams;
+  BandedAlignRowKernel mComputeRow;
+
+  std::vector< Profile > mProfiles;
+  std::vector< char >    mProfileLetters;
+  int                    mProfileOf[ 256 ];
+
+  Scores   mScores[ 2 ];
+  Scores   mVerticalScores[ 2 ];
+  Scores   mVerticalTerminal[ 2 ];
+  Scores   mHorizontalScores;
+  Scores   mMatches[ 2 ], mCols[ 2 ], mGaps[ 2 ];
+  CigarOps mRowOperations;
+
+  // Of the band only, row y and column x at band position x - y + bw + 1
+  std::vector< uint8_t > mOperations;
 
 public:
   BandedAlign( const BandedAlignParams& params = BandedAlignParams() )
-      : mParams( params ) {}
+      : mParams( params ) {
+    // The vector kernels rely on gap open scores <= 0
+    mComputeRow = ( params.interiorGapOpenScore <= 0 &&
+                    params.terminalGapOpenScore <= 0 )
+                    ? FastestBandedAlignRowKernel()
+                    : ComputeBandedAlignRow;
+    std::fill( mProfileOf, mProfileOf + 256, -1 );
+  }
 
+  // The matches and columns of the alignment can be counted along, with
+  // or (recording no ops then) without a cigar
   int Align( const Sequence< Alphabet >& A, const Sequence< Alphabet >& B,
              Cigar*                   cigar = NULL,
              const AlignmentDirection dir   = AlignmentDirection::Forward,
              size_t startA = 0, size_t startB = 0, size_t endA = -1,
-             size_t endB = -1 ) {
+             size_t endB = -1, AlignmentCounts* counts = NULL ) {
     // Calculate matrix width, depending on alignment
     // direction and length of sequences
     // A will be on the X axis (width of matrix)
@@ -124,21 +236,50 @@ public:
     width  = ( endA > startA ? endA - startA : startA - endA ) + 1;
     height = ( endB > startB ? endB - startB : startB - endB ) + 1;
 
-    // Make sure we have enough cells
-    if( mScores.capacity() < width ) {
-      mScores = Scores( width * 1.5, MinInt() );
-    }
+    size_t bw = mParams.bandwidth;
 
-    if( mVerticalGaps.capacity() < width ) {
-      mVerticalGaps = Gaps( width * 1.5, mParams );
+    // Bytes of a row of the band, packed 16 ops at a time
+    const size_t opsPerRow = ( 2 * bw + 2 + 15 ) / 16 * 4;
+    if( mOperations.capacity() < height * opsPerRow ) {
+      mOperations = std::vector< uint8_t >( height * opsPerRow * 1.5 );
     }
 
-    if( mOperations.capacity() < width * height ) {
-      mOperations = CigarOps( width * height * 1.5 );
+    // Both sequences are read in place, in alignment order
+    const bool forward = dir == AlignmentDirection::Forward;
+
+    // Rows of the band, sized once. A row is computed before it is read,
+    // except for the cells left of the band (out of the matrix) and row 0
+    // (up to the cell right of what row 1 reads), only those are reset.
+    size_t rowSize = 2 * bw + 2 + BandedAlignRowPadding;
+    if( mScores[ 0 ].size() < rowSize ) {
+      for( int i = 0; i < 2; i++ ) {
+        mScores[ i ].resize( rowSize );
+        mVerticalScores[ i ].resize( rowSize );
+        mVerticalTerminal[ i ].resize( rowSize );
+      }
+      mHorizontalScores.resize( rowSize );
+    }
+    if( counts && mMatches[ 0 ].size() < rowSize ) {
+      for( int i = 0; i < 2; i++ ) {
+        mMatches[ i ].resize( rowSize );
+        mCols[ i ].resize( rowSize );
+        mGaps[ i ].resize( rowSize );
+      }
+    }
+    if( mRowOperations.size() < std::max( rowSize, 4 * opsPerRow ) )
+      mRowOperations.resize( std::max( rowSize, 4 * opsPerRow ) );
+
+    for( int i = 0; i < 2; i++ ) {
+      const size_t numReset = i == 0 ? std::min( rowSize, 2 * bw + 3 ) : bw + 1;
+      std::fill_n( mScores[ i ].begin(), numReset, MinInt() );
+      std::fill_n( mVerticalScores[ i ].begin(), numReset, MinInt() );
+      std::fill_n( mVerticalTerminal[ i ].begin(), numReset, 0 );
+      if( counts ) {
+        std::fill_n( mMatches[ i ].begin(), numReset, 0 );
+        std::fill_n( mCols[ i ].begin(), numReset, 0 );
+        std::fill_n( mGaps[ i ].begin(), numReset, 0 );
+      }
     }
-
-    // Initialize first row
-    size_t bw = mParams.bandwidth;
 
     bool fromBeginningA = ( startA == 0 || startA == lenA );
     bool fromBeginningB = ( startB == 0 || startB == lenB );
@@ -146,111 +287,119 @@ public:
     bool fromEndA = ( endA == 0 || endA == lenA );
     bool fromEndB = ( endB == 0 || endB == lenB );
 
-    mScores[ 0 ] = 0;
-
-    mVerticalGaps[ 0 ].Reset();
-    mVerticalGaps[ 0 ].OpenOrExtend( mScores[ 0 ], fromBeginningB );
+    // Initialize first row
+    Gap verticalGap( mParams );
+    verticalGap.OpenOrExtend( 0, fromBeginningB );
+    mScores[ 0 ][ bw + 1 ]           = 0;
+    mVerticalScores[ 0 ][ bw + 1 ]   = verticalGap.Score();
+    mVerticalTerminal[ 0 ][ bw + 1 ] = verticalGap.IsTerminal() ? -1 : 0;
 
     Gap horizontalGap( mParams );
 
+    int    score = 0;
     size_t x, y;
     for( x = 1; x < width; x++ ) {
       if( x > bw && height > 1 ) // only break on BW bound if B is not empty
         break;
 
-      horizontalGap.OpenOrExtend( mScores[ x - 1 ], fromBeginningA );
-      mScores[ x ]     = horizontalGap.Score();
-      mOperations[ x ] = CigarOp::Insertion;
-      mVerticalGaps[ x ].Reset();
-    }
-    if( x < width ) {
-      mScores[ x ] = MinInt();
-      mVerticalGaps[ x ].Reset();
+      // Row 0 is insertions only, which the traceback knows
+      horizontalGap.OpenOrExtend( score, fromBeginningA );
+      score = horizontalGap.Score();
+      if( x <= bw ) {
+        mScores[ 0 ][ x + bw + 1 ] = score;
+        if( counts )
+          mCols[ 0 ][ x + bw + 1 ] = mGaps[ 0 ][ x + bw + 1 ] = x;
+      }
     }
-    /* PrintRow( width ); */
+    if( width > 1 )
+      verticalGap.Reset(); // only column 0 has one
 
     // Row by row...
-    size_t center = 1;
-    bool   hitEnd = false;
+    BandedAlignRow row;
+    row.horizontalScores       = mHorizontalScores.data();
+    row.operations             = mRowOperations.data();
+    row.verticalExtend         = mParams.interiorGapExtendScore;
+    row.verticalOpen           = mParams.interiorGapOpenScore + row.verticalExtend;
+    row.terminalVerticalExtend = mParams.terminalGapExtendScore;
+    row.terminalVerticalOpen =
+      mParams.terminalGapOpenScore + row.terminalVerticalExtend;
+
+    row.prevMatches = row.prevCols = row.prevGaps = NULL;
+    row.matches = row.cols = row.gaps = NULL;
+
+    size_t reach = std::min( width - 1, height - 1 + bw );
+    ClearProfiles();
+
+    bool hitEnd = false;
     for( y = 1; y < height && !hitEnd; y++ ) {
-      int score = MinInt();
-
       // Calculate band bounds
-      size_t leftBound =
-        std::min( center > bw ? ( center - bw ) : 0, width - 1 );
-      size_t rightBound = std::min( center + bw, width - 1 );
-
-      // Set diagonal score for first calculated cell in row
-      int diagScore = MinInt();
-      if( leftBound > 0 ) {
-        diagScore                = mScores[ leftBound - 1 ];
-        mScores[ leftBound - 1 ] = MinInt();
-        mVerticalGaps[ leftBound - 1 ].Reset();
+      size_t leftBound  = std::min( y > bw ? ( y - bw ) : 0, width - 1 );
+      size_t rightBound = std::min( y + bw, width - 1 );
+
+      // Band position 0 is column y - bw - 1 (left of the band, which can
+      // be needed when the band got cut at the end of A)
+      int offset = int( y ) - int( bw ) - 1;
+
+      const Scores& prevScores           = mScores[ ( y - 1 ) % 2 ];
+      const Scores& prevVerticalScores   = mVerticalScores[ ( y - 1 ) % 2 ];
+      const Scores& prevVerticalTerminal = mVerticalTerminal[ ( y - 1 ) % 2 ];
+      Scores&       scores               = mScores[ y % 2 ];
+      Scores&       verticalScores       = mVerticalScores[ y % 2 ];
+      Scores&       verticalTerminal     = mVerticalTerminal[ y % 2 ];
+
+      row.prevScores           = prevScores.data();
+      row.prevVerticalScores   = prevVerticalScores.data();
+      row.prevVerticalTerminal = prevVerticalTerminal.data();
+      row.scores               = scores.data();
+      row.verticalScores       = verticalScores.data();
+      row.verticalTerminal     = verticalTerminal.data();
+      if( counts ) {
+        row.prevMatches = mMatches[ ( y - 1 ) % 2 ].data();
+        row.prevCols    = mCols[ ( y - 1 ) % 2 ].data();
+        row.prevGaps    = mGaps[ ( y - 1 ) % 2 ].data();
+        row.matches     = mMatches[ y % 2 ].data();
+        row.cols        = mCols[ y % 2 ].data();
+        row.gaps        = mGaps[ y % 2 ].data();
       }
 
-      // Calculate row within the band bounds
-      horizontalGap.Reset();
-      for( x = leftBound; x <= rightBound; x++ ) {
-        // Calculate diagonal score
-        size_t aIdx = 0, bIdx = 0;
-        bool   match;
-        if( x > 0 ) {
-          aIdx =
-            ( dir == AlignmentDirection::Forward ) ? startA + x - 1 : startA - x;
-          bIdx =
-            ( dir == AlignmentDirection::Forward ) ? startB + y - 1 : startB - y;
-          // diagScore: score at col-1, row-1
-          match = MatchPolicy< Alphabet >::Match( A[ aIdx ], B[ bIdx ] );
-          score = diagScore + ScorePolicy< Alphabet >::Score( A[ aIdx ], B[ bIdx ] );
-        }
+      const char     b       = forward ? B[ startB + y - 1 ] : B[ startB - y ];
+      const Profile& profile = ProfileOf( b, A, startA, forward, reach );
+      row.diagonalScores     = profile.scores.data() + bw + 1 + offset;
+      row.diagonalOps        = profile.ops.data() + bw + 1 + offset;
 
-        // Select highest score
-        //  - coming from diag (current),
-        //  - coming from left (row)
-        //  - coming from top (col)
-        if( score < horizontalGap.Score() )
-          score = horizontalGap.Score();
-
-        Gap& verticalGap = mVerticalGaps[ x ];
-        if( score < verticalGap.Score() )
-          score = verticalGap.Score();
-
-        // Save the prev score at (x - 1) which
-        // we will use to compute the diagonal score at (x)
-        diagScore = mScores[ x ];
-
-        // Save new score
-        mScores[ x ] = score;
-
-        CigarOp op;
-        if( score == horizontalGap.Score() ) {
-          op = CigarOp::Insertion;
-        } else if( score == verticalGap.Score() ) {
-          op = CigarOp::Deletion;
-        } else {
-          op = match ? CigarOp::Match : CigarOp::Mismatch;
-        }
-        mOperations[ y * width + x ] = op;
+      row.first = int( leftBound ) - offset;
+      row.last  = int( rightBound ) - offset;
 
-        // Calculate potential gaps
-        bool isTerminalA = ( x == 0 || x == width - 1 ) && fromEndA;
-        bool isTerminalB = ( y == 0 || y == height - 1 ) && fromEndB;
+      row.terminalColumn1 = fromEndA ? -offset : -1;
+      row.terminalColumn2 = fromEndA ? int( width - 1 ) - offset : -1;
 
-        horizontalGap.OpenOrExtend( score, isTerminalB );
-        verticalGap.OpenOrExtend( score, isTerminalA );
-      }
+      bool isTerminalB     = ( y == height - 1 ) && fromEndB;
+      row.horizontalExtend = isTerminalB ? mParams.terminalGapExtendScore
+                                         : mParams.interiorGapExtendScore;
+      row.horizontalOpen =
+        ( isTerminalB ? mParams.terminalGapOpenScore
+                      : mParams.interiorGapOpenScore ) +
+        row.horizontalExtend;
 
-      if( rightBound + 1 < width ) {
-        mScores[ rightBound + 1 ] = MinInt();
-        mVerticalGaps[ rightBound + 1 ].Reset();
+      int horizontal = mComputeRow( row );
+      horizontalGap.Set( horizontal, isTerminalB );
+
+      if( cigar ) {
+        PackOperations( mRowOperations.data(), &mOperations[ y * opsPerRow ],
+                        opsPerRow );
       }
 
-      hitEnd = ( rightBound == leftBound );
+      // The column right of the band enters it on the next row
+      scores[ row.last + 1 ]           = MinInt();
+      verticalScores[ row.last + 1 ]   = MinInt();
+      verticalTerminal[ row.last + 1 ] = 0;
 
-      /* PrintRow( width ); */
+      score = scores[ row.last ];
+      verticalGap.Set( verticalScores[ row.last ],
+                       verticalTerminal[ row.last ] != 0 );
 
-      // Move one cell over for the next row
-      center++;
+      hitEnd = ( rightBound == leftBound );
+      x      = rightBound + 1;
     }
 
     // Backtrack
@@ -261,7 +410,12 @@ public:
       CigarEntry ce;
       cigar->Clear();
       while( bx != 0 || by != 0 ) {
-        CigarOp op = mOperations[ by * width + bx ];
+        CigarOp op = CigarOp::Insertion;
+        if( by > 0 ) {
+          size_t  pos = bx + bw + 1 - by;
+          uint8_t ops = mOperations[ by * opsPerRow + pos / 4 ];
+          op          = OperationOfCode( ( ops >> ( 2 * ( pos % 4 ) ) ) & 3 );
+        }
         cigar->Add( op );
 
         switch( op ) {
@@ -288,12 +442,32 @@ public:
       cigar->Reverse();
     }
 
+    if( counts ) {
+      // Of the cell the alignment ends in before the tails (row 0 is
+      // insertions only), and the tail
+      int matches = 0, cols = int( x - 1 ), gap = int( x - 1 );
+      if( y > 1 ) {
+        matches = mMatches[ ( y - 1 ) % 2 ][ row.last ];
+        cols    = mCols[ ( y - 1 ) % 2 ][ row.last ];
+        gap     = mGaps[ ( y - 1 ) % 2 ][ row.last ];
+      }
+      int tail = x == width    ? -int( height - y )
+                 : y == height ? int( width - x )
+                               : 0;
+
+      // A tail only continues a gap of the same kind
+      if( ( tail > 0 && gap < 0 ) || ( tail < 0 && gap > 0 ) )
+        gap = 0;
+
+      counts->matches = matches;
+      counts->cols    = cols + std::abs( tail );
+      counts->endGap  = std::abs( gap + tail );
+    }
+
     // Calculate score & cut corners
-    int score = mScores[ x - 1 ];
     if( x == width ) {
       // We reached the end of A, emulate going down on B (vertical gaps)
-      size_t remainingB  = height - y;
-      Gap&   verticalGap = mVerticalGaps[ x - 1 ];
+      size_t remainingB = height - y;
       verticalGap.OpenOrExtend( score, verticalGap.IsTerminal(), remainingB );
       score = verticalGap.Score();
 
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "Cigar.h"
+#include "Common.h"
+#include "Simd.h"
+
+#include <cstring>
+
+// One row of a banded alignment, indexed by position in the band
+// (x - y + bandwidth + 1). The cell diagonally up-left of a position is at the
+// same position in the row above, the cell straight above at the next one.
+// Vertical gaps are kept per cell as score plus terminal flag (0 or -1).
+struct BandedAlignRow {
+  const int* prevScores;
+  const int* prevVerticalScores;
+  const int* prevVerticalTerminal;
+
+  int*     scores;
+  int*     verticalScores;
+  int*     verticalTerminal;
+  int*     horizontalScores;
+  CigarOp* operations;
+
+  // Matches and columns of the path to each cell (the one the traceback
+  // would follow), and the gap it ends in (insertions counted positive,
+  // deletions negative). NULL if not counted.
+  const int* prevMatches;
+  const int* prevCols;
+  const int* prevGaps;
+  int*       matches;
+  int*       cols;
+  int*       gaps;
+
+  // Score and op of aligning A[ x ] to B[ y ], by band position
+  const int*     diagonalScores;
+  const CigarOp* diagonalOps;
+
+  int first, last;
+
+  // Band positions of the columns opening terminal vertical gaps
+  int terminalColumn1, terminalColumn2;
+
+  // Open scores include the first extension
+  int horizontalOpen, horizontalExtend;
+  int verticalOpen, verticalExtend;
+  int terminalVerticalOpen, terminalVerticalExtend;
+};
+
+// Computes cells first...last, returns the horizontal gap score after the
+// last one
+using BandedAlignRowKernel = int ( * )( const BandedAlignRow& );
+
+inline int ComputeBandedAlignRow( const BandedAlignRow& row ) {
+  int horizontal = MinInt();
+
+  for( int i = row.first; i <= row.last; i++ ) {
+    int vertical         = row.prevVerticalScores[ i + 1 ];
+    int verticalTerminal = row.prevVerticalTerminal[ i + 1 ];
+
+    int score = row.prevScores[ i ] + row.diagonalScores[ i ];
+    if( score < horizontal )
+      score = horizontal;
+    if( score < vertical )
+      score = vertical;
+
+    CigarOp op;
+    if( score == horizontal ) {
+      op = CigarOp::Insertion;
+    } else if( score == vertical ) {
+      op = CigarOp::Deletion;
+    } else {
+      op = row.diagonalOps[ i ];
+    }
+
+    row.scores[ i ]           = score;
+    row.operations[ i ]       = op;
+    row.horizontalScores[ i ] = horizontal;
+
+    if( row.matches ) {
+      if( op == CigarOp::Insertion ) {
+        row.matches[ i ] = row.matches[ i - 1 ];
+        row.cols[ i ]    = row.cols[ i - 1 ] + 1;
+        row.gaps[ i ]    = std::max( row.gaps[ i - 1 ], 0 ) + 1;
+      } else if( op == CigarOp::Deletion ) {
+        row.matches[ i ] = row.prevMatches[ i + 1 ];
+        row.cols[ i ]    = row.prevCols[ i + 1 ] + 1;
+        row.gaps[ i ]    = std::min( row.prevGaps[ i + 1 ], 0 ) - 1;
+      } else {
+        row.matches[ i ] = row.prevMatches[ i ] + ( op == CigarOp::Match );
+        row.cols[ i ]    = row.prevCols[ i ] + 1;
+        row.gaps[ i ]    = 0;
+      }
+    }
+
+    horizontal = std::max( horizontal + row.horizontalExtend,
+                           score + row.horizontalOpen );
+
+    bool terminal = i == row.terminalColumn1 || i == row.terminalColumn2;
+    int  extended = vertical + ( verticalTerminal ? row.terminalVerticalExtend
+                                                  : row.verticalExtend );
+    int  opened   = score + ( terminal ? row.terminalVerticalOpen
+                                       : row.verticalOpen );
+    if( opened > extended ) {
+      row.verticalScores[ i ]   = opened;
+      row.verticalTerminal[ i ] = terminal ? -1 : 0;
+    } else {
+      row.verticalScores[ i ]   = extended;
+      row.verticalTerminal[ i ] = verticalTerminal;
+    }
+  }
+
+  return horizontal;
+}
+
+// The vector kernels find all horizontal gaps of a row at once, as a running
+// maximum of (score without horizontal gap - position * extend). Opening a
+// gap right after another one must then never beat extending it, so they
+// are only used for gap open scores <= 0. Cells past row.last are computed
+// too (and thrown away), the arrays are padded for that.
+//
+// Counting, an insertion continues the cell left of it. A segmented scan
+// carries the matches, columns and position of the last cell that isn't one
+// to the insertions after it (from the carry of the cells before, starting
+// with the one left of the row).
+#ifdef USE_X86_SIMD
+
+__attribute__( ( target( "sse4.1" ) ) ) inline void
+CountBandedAlignRowSSE41( const BandedAlignRow& row, const int i,
+                          const __m128i op, const __m128i positions,
+                          __m128i carry[ 3 ] ) {
+  const __m128i one = _mm_set1_epi32( 1 ), zero = _mm_setzero_si128();
+  __m128i isMatch =
+    _mm_cmpeq_epi32( op, _mm_set1_epi32( int( CigarOp::Match ) ) );
+  __m128i isDeletion =
+    _mm_cmpeq_epi32( op, _mm_set1_epi32( int( CigarOp::Deletion ) ) );
+  __m128i isInsertion =
+    _mm_cmpeq_epi32( op, _mm_set1_epi32( int( CigarOp::Insertion ) ) );
+
+  __m128i matches = _mm_blendv_epi8(
+    _mm_sub_epi32( _mm_loadu_si128( ( const __m128i* )( row.prevMatches + i ) ),
+                   isMatch ),
+    _mm_loadu_si128( ( const __m128i* )( row.prevMatches + i + 1 ) ),
+    isDeletion );
+  __m128i cols = _mm_add_epi32(
+    _mm_blendv_epi8(
+      _mm_loadu_si128( ( const __m128i* )( row.prevCols + i ) ),
+      _mm_loadu_si128( ( const __m128i* )( row.prevCols + i + 1 ) ),
+      isDeletion ),
+    one );
+  __m128i gaps = _mm_and_si128(
+    _mm_sub_epi32(
+      _mm_min_epi32(
+        _mm_loadu_si128( ( const __m128i* )( row.prevGaps + i + 1 ) ), zero ),
+      one ),
+    isDeletion );
+
+  // Lanes shifted in from before the first are not found
+  __m128i from  = positions;
+  __m128i found = _mm_xor_si128( isInsertion, _mm_set1_epi32( -1 ) );
+  matches = _mm_blendv_epi8( _mm_slli_si128( matches, 4 ), matches, found );
+  cols    = _mm_blendv_epi8( _mm_slli_si128( cols, 4 ), cols, found );
+  from    = _mm_blendv_epi8( _mm_slli_si128( from, 4 ), from, found );
+  found   = _mm_or_si128( found, _mm_slli_si128( found, 4 ) );
+  matches = _mm_blendv_epi8( _mm_slli_si128( matches, 8 ), matches, found );
+  cols    = _mm_blendv_epi8( _mm_slli_si128( cols, 8 ), cols, found );
+  from    = _mm_blendv_epi8( _mm_slli_si128( from, 8 ), from, found );
+  found   = _mm_or_si128( found, _mm_slli_si128( found, 8 ) );
+
+  matches    = _mm_blendv_epi8( carry[ 0 ], matches, found );
+  cols       = _mm_blendv_epi8( carry[ 1 ], cols, found );
+  from       = _mm_blendv_epi8( carry[ 2 ], from, found );
+  carry[ 0 ] = _mm_shuffle_epi32( matches, 0xFF );
+  carry[ 1 ] = _mm_shuffle_epi32( cols, 0xFF );
+  carry[ 2 ] = _mm_shuffle_epi32( from, 0xFF );
+
+  __m128i run = _mm_sub_epi32( positions, from );
+  _mm_storeu_si128( ( __m128i* )( row.matches + i ), matches );
+  _mm_storeu_si128( ( __m128i* )( row.cols + i ), _mm_add_epi32( cols, run ) );
+  _mm_storeu_si128( ( __m128i* )( row.gaps + i ),
+                    _mm_blendv_epi8( gaps, run, isInsertion ) );
+}
+
+__attribute__( ( target( "avx2" ) ) ) inline void
+CountBandedAlignRowAVX2( const BandedAlignRow& row, const int i,
+                         const __m256i op, const __m256i positions,
+                         __m256i carry[ 3 ] ) {
+  const __m256i one = _mm256_set1_epi32( 1 ), zero = _mm256_setzero_si256();
+  const __m256i shifts[ 3 ] = { _mm256_setr_epi32( 0, 0, 1, 2, 3, 4, 5, 6 ),
+                                _mm256_setr_epi32( 0, 0, 0, 1, 2, 3, 4, 5 ),
+                                _mm256_setr_epi32( 0, 0, 0, 0, 0, 1, 2, 3 ) };
+  const __m256i shiftedLanes[ 3 ] = {
+    _mm256_setr_epi32( 0, -1, -1, -1, -1, -1, -1, -1 ),
+    _mm256_setr_epi32( 0, 0, -1, -1, -1, -1, -1, -1 ),
+    _mm256_setr_epi32( 0, 0, 0, 0, -1, -1, -1, -1 ) };
+  __m256i isMatch =
+    _mm256_cmpeq_epi32( op, _mm256_set1_epi32( int( CigarOp::Match ) ) );
+  __m256i isDeletion =
+    _mm256_cmpeq_epi32( op, _mm256_set1_epi32( int( CigarOp::Deletion ) ) );
+  __m256i isInsertion =
+    _mm256_cmpeq_epi32( op, _mm256_set1_epi32( int( CigarOp::Insertion ) ) );
+
+  __m256i matches = _mm256_blendv_epi8(
+    _mm256_sub_epi32(
+      _mm256_loadu_si256( ( const __m256i* )( row.prevMatches + i ) ),
+      isMatch ),
+    _mm256_loadu_si256( ( const __m256i* )( row.prevMatches + i + 1 ) ),
+    isDeletion );
+  __m256i cols = _mm256_add_epi32(
+    _mm256_blendv_epi8(
+      _mm256_loadu_si256( ( const __m256i* )( row.prevCols + i ) ),
+      _mm256_loadu_si256( ( const __m256i* )( row.prevCols + i + 1 ) ),
+      isDeletion ),
+    one );
+  __m256i gaps = _mm256_and_si256(
+    _mm256_sub_epi32(
+      _mm256_min_epi32(
+        _mm256_loadu_si256( ( const __m256i* )( row.prevGaps + i + 1 ) ),
+        zero ),
+      one ),
+    isDeletion );
+
+  // Lanes shifted in from before the first are not found
+  __m256i from  = positions;
+  __m256i found = _mm256_xor_si256( isInsertion, _mm256_set1_epi32( -1 ) );
+  for( int s = 0; s < 3; s++ ) {
+    __m256i shiftedFound = _mm256_and_si256(
+      _mm256_permutevar8x32_epi32( found, shifts[ s ] ), shiftedLanes[ s ] );
+    matches = _mm256_blendv_epi8(
+      _mm256_permutevar8x32_epi32( matches, shifts[ s ] ), matches, found );
+    cols = _mm256_blendv_epi8(
+      _mm256_permutevar8x32_epi32( cols, shifts[ s ] ), cols, found );
+    from = _mm256_blendv_epi8(
+      _mm256_permutevar8x32_epi32( from, shifts[ s ] ), from, found );
+    found = _mm256_or_si256( found, shiftedFound );
+  }
+
+  const __m256i lastLane = _mm256_set1_epi32( 7 );
+  matches    = _mm256_blendv_epi8( carry[ 0 ], matches, found );
+  cols       = _mm256_blendv_epi8( carry[ 1 ], cols, found );
+  from       = _mm256_blendv_epi8( carry[ 2 ], from, found );
+  carry[ 0 ] = _mm256_permutevar8x32_epi32( matches, lastLane );
+  carry[ 1 ] = _mm256_permutevar8x32_epi32( cols, lastLane );
+  carry[ 2 ] = _mm256_permutevar8x32_epi32( from, lastLane );
+
+  __m256i run = _mm256_sub_epi32( positions, from );
+  _mm256_storeu_si256( ( __m256i* )( row.matches + i ), matches );
+  _mm256_storeu_si256( ( __m256i* )( row.cols + i ),
+                       _mm256_add_epi32( cols, run ) );
+  _mm256_storeu_si256( ( __m256i* )( row.gaps + i ),
+                       _mm256_blendv_epi8( gaps, run, isInsertion ) );
+}
+
+__attribute__( ( target( "sse4.1" ) ) ) inline int
+ComputeBandedAlignRowSSE41( const BandedAlignRow& row ) {
+  const __m128i minInt    = _mm_set1_epi32( MinInt() );
+  const __m128i hOpen     = _mm_set1_epi32( row.horizontalOpen );
+  const __m128i hExtend   = _mm_set1_epi32( row.horizontalExtend );
+  const __m128i vOpen     = _mm_set1_epi32( row.verticalOpen );
+  const __m128i vExtend   = _mm_set1_epi32( row.verticalExtend );
+  const __m128i tvOpen    = _mm_set1_epi32( row.terminalVerticalOpen );
+  const __m128i tvExtend  = _mm_set1_epi32( row.terminalVerticalExtend );
+  const __m128i terminal1 = _mm_set1_epi32( row.terminalColumn1 );
+  const __m128i terminal2 = _mm_set1_epi32( row.terminalColumn2 );
+  const __m128i insertion = _mm_set1_epi32( int( CigarOp::Insertion ) );
+  const __m128i deletion  = _mm_set1_epi32( int( CigarOp::Deletion ) );
+
+  __m128i positions = _mm_add_epi32( _mm_set1_epi32( row.first ),
+                                     _mm_setr_epi32( 0, 1, 2, 3 ) );
+  // position * extend, relative to the first cell
+  __m128i offsets =
+    _mm_setr_epi32( 0, row.horizontalExtend, 2 * row.horizontalExtend,
+                    3 * row.horizontalExtend );
+  __m128i carry   = minInt;
+
+  __m128i counted[ 3 ] = { minInt, minInt, minInt };
+  if( row.matches ) {
+    counted[ 0 ] = _mm_set1_epi32( row.matches[ row.first - 1 ] );
+    counted[ 1 ] = _mm_set1_epi32( row.cols[ row.first - 1 ] );
+    counted[ 2 ] = _mm_set1_epi32( row.first - 1 );
+  }
+
+  for( int i = row.first; i <= row.last; i += 4 ) {
+    __m128i diagonal = _mm_add_epi32(
+      _mm_loadu_si128( ( const __m128i* )( row.prevScores + i ) ),
+      _mm_loadu_si128( ( const __m128i* )( row.diagonalScores + i ) ) );
+    __m128i vertical = _mm_loadu_si128(
+      ( const __m128i* )( row.prevVerticalScores + i + 1 ) );
+    __m128i verticalTerminal = _mm_loadu_si128(
+      ( const __m128i* )( row.prevVerticalTerminal + i + 1 ) );
+    __m128i score = _mm_max_epi32( diagonal, vertical );
+
+    // Best horizontal gap opened before each cell
+    __m128i g = _mm_sub_epi32( score, offsets );
+    g         = _mm_max_epi32( g, _mm_alignr_epi8( g, minInt, 12 ) );
+    g         = _mm_max_epi32( g, _mm_alignr_epi8( g, minInt, 8 ) );
+    __m128i before =
+      _mm_max_epi32( _mm_alignr_epi8( g, carry, 12 ), carry );
+    carry = _mm_max_epi32( carry, _mm_shuffle_epi32( g, 0xFF ) );
+
+    __m128i horizontal = _mm_add_epi32(
+      _mm_add_epi32( before, _mm_sub_epi32( offsets, hExtend ) ), hOpen );
+    score = _mm_max_epi32( score, horizontal );
+
+    int diagonalOps;
+    memcpy( &diagonalOps, row.diagonalOps + i, sizeof( diagonalOps ) );
+    __m128i op = _mm_cvtepi8_epi32( _mm_cvtsi32_si128( diagonalOps ) );
+    op = _mm_blendv_epi8( op, deletion, _mm_cmpeq_epi32( score, vertical ) );
+    op = _mm_blendv_epi8( op, insertion, _mm_cmpeq_epi32( score, horizontal ) );
+    if( row.matches )
+      CountBandedAlignRowSSE41( row, i, op, positions, counted );
+    op = _mm_packus_epi16( _mm_packs_epi32( op, op ), op );
+    int ops = _mm_cvtsi128_si32( op );
+    memcpy( row.operations + i, &ops, sizeof( ops ) );
+
+    _mm_storeu_si128( ( __m128i* )( row.scores + i ), score );
+    _mm_storeu_si128( ( __m128i* )( row.horizontalScores + i ), horizontal );
+
+    __m128i terminal =
+      _mm_or_si128( _mm_cmpeq_epi32( positions, terminal1 ),
+                    _mm_cmpeq_epi32( positions, terminal2 ) );
+    __m128i extended = _mm_add_epi32(
+      vertical, _mm_blendv_epi8( vExtend, tvExtend, verticalTerminal ) );
+    __m128i opened =
+      _mm_add_epi32( score, _mm_blendv_epi8( vOpen, tvOpen, terminal ) );
+    __m128i open = _mm_cmpgt_epi32( opened, extended );
+    _mm_storeu_si128( ( __m128i* )( row.verticalScores + i ),
+                      _mm_blendv_epi8( extended, opened, open ) );
+    _mm_storeu_si128( ( __m128i* )( row.verticalTerminal + i ),
+                      _mm_blendv_epi8( verticalTerminal, terminal, open ) );
+
+    positions = _mm_add_epi32( positions, _mm_set1_epi32( 4 ) );
+    offsets =
+      _mm_add_epi32( offsets, _mm_set1_epi32( 4 * row.horizontalExtend ) );
+  }
+
+  return std::max( row.horizontalScores[ row.last ] + row.horizontalExtend,
+                   row.scores[ row.last ] + row.horizontalOpen );
+}
+
+__attribute__( ( target( "avx2" ) ) ) inline int
+ComputeBandedAlignRowAVX2( const BandedAlignRow& row ) {
+  const __m256i minInt    = _mm256_set1_epi32( MinInt() );
+  const __m256i hOpen     = _mm256_set1_epi32( row.horizontalOpen );
+  const __m256i hExtend   = _mm256_set1_epi32( row.horizontalExtend );
+  const __m256i vOpen     = _mm256_set1_epi32( row.verticalOpen );
+  const __m256i vExtend   = _mm256_set1_epi32( row.verticalExtend );
+  const __m256i tvOpen    = _mm256_set1_epi32( row.terminalVerticalOpen );
+  const __m256i tvExtend  = _mm256_set1_epi32( row.terminalVerticalExtend );
+  const __m256i terminal1 = _mm256_set1_epi32( row.terminalColumn1 );
+  const __m256i terminal2 = _mm256_set1_epi32( row.terminalColumn2 );
+  const __m256i insertion = _mm256_set1_epi32( int( CigarOp::Insertion ) );
+  const __m256i deletion  = _mm256_set1_epi32( int( CigarOp::Deletion ) );
+  const __m256i lanes     = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+  const __m256i shift1    = _mm256_setr_epi32( 0, 0, 1, 2, 3, 4, 5, 6 );
+  const __m256i shift2    = _mm256_setr_epi32( 0, 0, 0, 1, 2, 3, 4, 5 );
+  const __m256i shift4    = _mm256_setr_epi32( 0, 0, 0, 0, 0, 1, 2, 3 );
+  const __m256i lastLane  = _mm256_set1_epi32( 7 );
+
+  __m256i positions = _mm256_add_epi32( _mm256_set1_epi32( row.first ), lanes );
+  // position * extend, relative to the first cell
+  __m256i offsets =
+    _mm256_mullo_epi32( lanes, _mm256_set1_epi32( row.horizontalExtend ) );
+  __m256i carry = minInt;
+
+  __m256i counted[ 3 ] = { minInt, minInt, minInt };
+  if( row.matches ) {
+    counted[ 0 ] = _mm256_set1_epi32( row.matches[ row.first - 1 ] );
+    counted[ 1 ] = _mm256_set1_epi32( row.cols[ row.first - 1 ] );
+    counted[ 2 ] = _mm256_set1_epi32( row.first - 1 );
+  }
+
+  for( int i = row.first; i <= row.last; i += 8 ) {
+    __m256i diagonal = _mm256_add_epi32(
+      _mm256_loadu_si256( ( const __m256i* )( row.prevScores + i ) ),
+      _mm256_loadu_si256( ( const __m256i* )( row.diagonalScores + i ) ) );
+    __m256i vertical = _mm256_loadu_si256(
+      ( const __m256i* )( row.prevVerticalScores + i + 1 ) );
+    __m256i verticalTerminal = _mm256_loadu_si256(
+      ( const __m256i* )( row.prevVerticalTerminal + i + 1 ) );
+    __m256i score = _mm256_max_epi32( diagonal, vertical );
+
+    // Best horizontal gap opened before each cell
+    __m256i g = _mm256_sub_epi32( score, offsets );
+    g         = _mm256_max_epi32(
+      g, _mm256_blend_epi32( _mm256_permutevar8x32_epi32( g, shift1 ), minInt,
+                             0x01 ) );
+    g = _mm256_max_epi32(
+      g, _mm256_blend_epi32( _mm256_permutevar8x32_epi32( g, shift2 ), minInt,
+                             0x03 ) );
+    g = _mm256_max_epi32(
+      g, _mm256_blend_epi32( _mm256_permutevar8x32_epi32( g, shift4 ), minInt,
+                             0x0F ) );
+    __m256i before = _mm256_max_epi32(
+      _mm256_blend_epi32( _mm256_permutevar8x32_epi32( g, shift1 ), carry,
+                          0x01 ),
+      carry );
+    carry =
+      _mm256_max_epi32( carry, _mm256_permutevar8x32_epi32( g, lastLane ) );
+
+    __m256i horizontal = _mm256_add_epi32(
+      _mm256_add_epi32( before, _mm256_sub_epi32( offsets, hExtend ) ), hOpen );
+    score = _mm256_max_epi32( score, horizontal );
+
+    __m256i op = _mm256_cvtepi8_epi32(
+      _mm_loadl_epi64( ( const __m128i* )( row.diagonalOps + i ) ) );
+    op = _mm256_blendv_epi8( op, deletion,
+                             _mm256_cmpeq_epi32( score, vertical ) );
+    op = _mm256_blendv_epi8( op, insertion,
+                             _mm256_cmpeq_epi32( score, horizontal ) );
+    if( row.matches )
+      CountBandedAlignRowAVX2( row, i, op, positions, counted );
+    __m128i ops = _mm_packs_epi32( _mm256_castsi256_si128( op ),
+                                   _mm256_extracti128_si256( op, 1 ) );
+    _mm_storel_epi64( ( __m128i* )( row.operations + i ),
+                      _mm_packus_epi16( ops, ops ) );
+
+    _mm256_storeu_si256( ( __m256i* )( row.scores + i ), score );
+    _mm256_storeu_si256( ( __m256i* )( row.horizontalScores + i ), horizontal );
+
+    __m256i terminal =
+      _mm256_or_si256( _mm256_cmpeq_epi32( positions, terminal1 ),
+                       _mm256_cmpeq_epi32( positions, terminal2 ) );
+    __m256i extended = _mm256_add_epi32(
+      vertical, _mm256_blendv_epi8( vExtend, tvExtend, verticalTerminal ) );
+    __m256i opened =
+      _mm256_add_epi32( score, _mm256_blendv_epi8( vOpen, tvOpen, terminal ) );
+    __m256i open = _mm256_cmpgt_epi32( opened, extended );
+    _mm256_storeu_si256( ( __m256i* )( row.verticalScores + i ),
+                         _mm256_blendv_epi8( extended, opened, open ) );
+    _mm256_storeu_si256(
+      ( __m256i* )( row.verticalTerminal + i ),
+      _mm256_blendv_epi8( verticalTerminal, terminal, open ) );
+
+    positions = _mm256_add_epi32( positions, _mm256_set1_epi32( 8 ) );
+    offsets   = _mm256_add_epi32(
+      offsets, _mm256_set1_epi32( 8 * row.horizontalExtend ) );
+  }
+
+  return std::max( row.horizontalScores[ row.last ] + row.horizontalExtend,
+                   row.scores[ row.last ] + row.horizontalOpen );
+}
+
+#endif
+
+// Row padding the vector kernels need
+static const int BandedAlignRowPadding = 8;
+
+inline BandedAlignRowKernel FastestBandedAlignRowKernel() {
+#ifdef USE_X86_SIMD
+  switch( SupportedSimdLevel() ) {
+    case SimdLevel::AVX2: return ComputeBandedAlignRowAVX2;
+    case SimdLevel::SSE41: return ComputeBandedAlignRowSSE41;
+    default: break;
+  }
+#endif
+  return ComputeBandedAlignRow;
+}
@@ -2,7 +2,6 @@
 
 #include "../Utils.h"
 
-#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -31,7 +30,7 @@ public:
   }
 };
 
-class Cigar : public std::deque< CigarEntry > {
+class Cigar : public std::vector< CigarEntry > {
 public:
   Cigar() {}
 
@@ -141,6 +140,14 @@ public:
   }
 };
 
+// What the identity of an alignment is told from, counted without its
+// cigar: match columns, columns, and the gap columns it ends in at the far
+// end from where it was aligned from (its first ones aligning in reverse)
+struct AlignmentCounts {
+  size_t matches = 0, cols = 0;
+  size_t endGap  = 0;
+};
+
 static std::ostream& operator<<( std::ostream& os, const Cigar& cigar ) {
   return ( os << cigar.ToString() );
 }
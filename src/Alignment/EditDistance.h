@@ -0,0 +1,188 @@
+#pragma once
+
+#include "Common.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Unit cost edit distance (mismatches and gap columns, MatchPolicy decides
+// what matches) by Myers' bit-vector algorithm, in Hyyro's version for
+// sequences longer than a word: a column of the DP (one bit per position of
+// A, 64 per word) is advanced by a whole letter of B at once.
+template < typename Alphabet >
+class EditDistance {
+public:
+  // Whether gaps at the start or end of either sequence cost anything
+  enum class FreeGaps { None, Leading, Trailing };
+
+  EditDistance() {
+    std::fill( mPeqOf, mPeqOf + 256, -1 );
+  }
+
+  // Of A[ a1, a2 ) and B[ b1, b2 )
+  size_t Compute( const Sequence< Alphabet >& A, const size_t a1, const size_t a2,
+                  const Sequence< Alphabet >& B, const size_t b1, const size_t b2,
+                  const FreeGaps free = FreeGaps::None ) {
+    const size_t lenA = a2 - a1, lenB = b2 - b1;
+    if( lenA == 0 || lenB == 0 )
+      return free == FreeGaps::None ? lenA + lenB : 0;
+
+    // Trailing gaps are leading ones of the reversed sequences
+    const bool reverse = free == FreeGaps::Trailing;
+    mA.resize( lenA );
+    for( size_t i = 0; i < lenA; i++ )
+      mA[ i ] = reverse ? A[ a2 - 1 - i ] : A[ a1 + i ];
+
+    const size_t numWords = ( lenA + WordBits - 1 ) / WordBits;
+    const Word   highBit  = Word( 1 ) << ( WordBits - 1 );
+    const Word   lastBit  = Word( 1 ) << ( ( lenA - 1 ) % WordBits );
+    const int    topDelta = free == FreeGaps::None ? 1 : 0;
+
+    // Vertical deltas of column 0 (+1 each, or 0 if leading gaps are free)
+    mPositive.assign( numWords, free == FreeGaps::None ? ~Word( 0 ) : 0 );
+    mNegative.assign( numWords, 0 );
+
+    ClearPeqs();
+    long distance = free == FreeGaps::None ? lenA : 0;
+    for( size_t j = 0; j < lenB; j++ ) {
+      const Word* peq = PeqOf( reverse ? B[ b2 - 1 - j ] : B[ b1 + j ], numWords );
+
+      int delta = topDelta;
+      for( size_t w = 0; w < numWords; w++ ) {
+        delta = Advance( w, peq[ w ], delta,
+                         w + 1 == numWords ? lastBit : highBit );
+      }
+      distance += delta;
+    }
+
+    return distance;
+  }
+
+  // Highest identity (matches over columns, a gap at either end left out,
+  // see Cigar::Identity) any alignment of A and B can reach. With the
+  // terminal gaps free, an alignment of identity M / ( M + E ) has E at
+  // least the edit distance of the parts it overlaps, and M at most the
+  // shorter of them. Ending a leading gap in A (or B) and starting a
+  // trailing gap in A (or B) gives the 4 ways to overlap: the last row and
+  // column of the DP (leading gaps free in A, then in B) cover them all.
+  float MaxIdentity( const Sequence< Alphabet >& A,
+                     const Sequence< Alphabet >& B ) {
+    const size_t lenA = A.Length(), lenB = B.Length();
+    if( lenA == 0 || lenB == 0 )
+      return 0.0f;
+
+    mA.resize( lenA );
+    for( size_t i = 0; i < lenA; i++ )
+      mA[ i ] = A[ i ];
+
+    const size_t numWords = ( lenA + WordBits - 1 ) / WordBits;
+    const Word   highBit  = Word( 1 ) << ( WordBits - 1 );
+    const Word   lastBit  = Word( 1 ) << ( ( lenA - 1 ) % WordBits );
+
+    size_t bestMatches = 0, bestCols = 1;
+    auto   consider = [&]( const size_t matches, const long distance ) {
+      size_t cols = matches + distance;
+      if( matches * bestCols > bestMatches * cols ) {
+        bestMatches = matches;
+        bestCols    = cols;
+      }
+    };
+
+    ClearPeqs();
+    for( int freeInA = 1; freeInA >= 0; freeInA-- ) {
+      const int topDelta = freeInA ? 1 : 0;
+      mPositive.assign( numWords, freeInA ? 0 : ~Word( 0 ) );
+      mNegative.assign( numWords, 0 );
+
+      // Last row
+      long distance = freeInA ? 0 : lenA;
+      for( size_t j = 0; j < lenB; j++ ) {
+        const Word* peq = PeqOf( B[ j ], numWords );
+
+        int delta = topDelta;
+        for( size_t w = 0; w < numWords; w++ ) {
+          delta = Advance( w, peq[ w ], delta,
+                           w + 1 == numWords ? lastBit : highBit );
+        }
+        distance += delta;
+        consider( std::min( j + 1, lenA ), distance );
+      }
+
+      // Last column
+      distance = freeInA ? lenB : 0;
+      for( size_t i = 0; i < lenA; i++ ) {
+        const Word bit = Word( 1 ) << ( i % WordBits );
+        distance += ( mPositive[ i / WordBits ] & bit ? 1 : 0 ) -
+                    ( mNegative[ i / WordBits ] & bit ? 1 : 0 );
+        consider( std::min( i + 1, lenB ), distance );
+      }
+    }
+
+    return float( bestMatches ) / float( bestCols );
+  }
+
+private:
+  using Word = uint64_t;
+
+  static const size_t WordBits = 64;
+
+  // Advances one word of the column, given the horizontal delta entering
+  // it from above; returns the one leaving it at outBit
+  int Advance( const size_t w, Word eq, const int delta, const Word outBit ) {
+    Word positive = mPositive[ w ], negative = mNegative[ w ];
+
+    const Word deltaIsNegative = delta < 0 ? 1 : 0;
+    const Word deltaIsPositive = delta > 0 ? 1 : 0;
+
+    Word xv = eq | negative;
+    eq |= deltaIsNegative;
+    Word xh = ( ( ( eq & positive ) + positive ) ^ positive ) | eq;
+
+    Word ph = negative | ~( xh | positive );
+    Word mh = positive & xh;
+
+    int out = ( ph & outBit ? 1 : 0 ) - ( mh & outBit ? 1 : 0 );
+
+    ph = ( ph << 1 ) | deltaIsPositive;
+    mh = ( mh << 1 ) | deltaIsNegative;
+
+    mPositive[ w ] = mh | ~( xv | ph );
+    mNegative[ w ] = ph & xv;
+
+    return out;
+  }
+
+  // Bits of the positions of A matching a letter, built as letters of B
+  // turn up
+  const Word* PeqOf( const char letter, const size_t numWords ) {
+    int& index = mPeqOf[ ( unsigned char )letter ];
+    if( index < 0 ) {
+      index = mPeqLetters.size();
+      mPeqLetters.push_back( letter );
+      mPeqs.resize( mPeqLetters.size() * numWords );
+
+      Word* peq = &mPeqs[ index * numWords ];
+      std::fill( peq, peq + numWords, 0 );
+      for( size_t i = 0; i < mA.size(); i++ ) {
+        if( MatchPolicy< Alphabet >::Match( mA[ i ], letter ) )
+          peq[ i / WordBits ] |= Word( 1 ) << ( i % WordBits );
+      }
+    }
+
+    return &mPeqs[ index * numWords ];
+  }
+
+  void ClearPeqs() {
+    for( auto letter : mPeqLetters )
+      mPeqOf[ ( unsigned char )letter ] = -1;
+    mPeqLetters.clear();
+  }
+
+  std::string         mA;
+  std::vector< Word > mPositive, mNegative;
+  std::vector< Word > mPeqs;
+  std::vector< char > mPeqLetters;
+  int                 mPeqOf[ 256 ];
+};
@@ -3,8 +3,9 @@
 #include "Cigar.h"
 #include "Common.h"
 
+#include <algorithm>
 #include <cassert>
-#include <iostream>
+#include <cstddef>
 #include <vector>
 
 typedef struct ExtendAlignParams {
@@ -18,7 +19,11 @@ typedef struct ExtendedAlignment {
   Cigar cigar;
 } ExtendedAlignment;
 
-// Influenced by Blast's SemiGappedAlign function
+// Influenced by Blast's SemiGappedAlign function. The DP is filled row by
+// row, each cell X-drop tested against the best score of the cells before
+// it. The matches and columns up to the best cell can be counted along (by
+// following the cells' ops as the traceback would), with or (recording no
+// ops then) without a cigar.
 template < typename Alphabet >
 class ExtendAlign {
 private:
@@ -28,20 +33,20 @@ private:
   };
   using Cells = std::vector< Cell >;
 
-  void Print( const Cells& row ) {
-    for( auto& c : row ) {
-      if( c.score <= MinInt() ) {
-        printf( "%5c", 'X' );
-      } else {
-        printf( "%5d", c.score );
-      }
-    }
-    printf( "\n" );
-  }
+  // Of the path to a cell
+  struct CellCounts {
+    int matches = 0;
+    int cols    = 0;
+  };
+
+  ExtendAlignParams         mAP;
+  Cells                     mRow;
+  std::vector< CellCounts > mRowCounts;
 
-  ExtendAlignParams mAP;
-  Cells             mRow;
-  CigarOps          mOperations;
+  // The computed cells of each row one after another, column x of row y
+  // at mOffsets[ y ] + x
+  CigarOps                  mOperations;
+  std::vector< ptrdiff_t >  mOffsets;
 
 public:
   ExtendAlign( const ExtendAlignParams& ap = ExtendAlignParams() )
@@ -51,11 +56,13 @@ public:
     return mAP;
   }
 
-  // Heavily influenced by Blast's SemiGappedAlign function
+  // Heavily influenced by Blast's SemiGappedAlign function. The best cell
+  // is never reached by a gap, so counts leave endGap 0.
   int Extend( const Sequence< Alphabet >& A, const Sequence< Alphabet >& B,
               size_t* bestA = NULL, size_t* bestB = NULL, Cigar* cigar = NULL,
               const AlignmentDirection dir = AlignmentDirection::Forward,
-              size_t startA = 0, size_t startB = 0 ) {
+              size_t startA = 0, size_t startB = 0,
+              AlignmentCounts* counts = NULL ) {
     int    score;
     size_t x, y;
     size_t aIdx, bIdx;
@@ -76,10 +83,27 @@ public:
       mRow = Cells( width * 1.5 );
     }
 
-    if( mOperations.capacity() < width * height ) {
-      mOperations = CigarOps( width * height * 1.5 );
+    // Counts of the row's cells (of the row above right of the current
+    // cell), of the cells left of and diagonally up-left of it and of the
+    // best one
+    CellCounts* rowCounts = NULL;
+    CellCounts  leftCounts, diagCounts, bestCounts;
+    if( counts ) {
+      if( mRowCounts.size() < width )
+        mRowCounts.resize( width * 1.5 );
+      rowCounts = mRowCounts.data();
     }
 
+    // Only what X-Drop left of a row is stored, and only for a traceback
+    size_t numOperations = 0;
+    mOffsets.clear();
+    auto reserveRow = [&]( const size_t firstX ) {
+      size_t needed = numOperations + width - firstX;
+      if( mOperations.size() < needed )
+        mOperations.resize( needed * 1.5 );
+      mOffsets.push_back( ptrdiff_t( numOperations ) - ptrdiff_t( firstX ) );
+    };
+
     bestX = 0;
     bestY = 0;
 
@@ -92,18 +116,31 @@ public:
     mRow[ 0 ].score    = 0;
     mRow[ 0 ].scoreGap = mAP.gapOpenScore + mAP.gapExtendScore;
 
+    CigarOp* rowOperations = NULL;
+    if( cigar ) {
+      reserveRow( 0 );
+      rowOperations = mOperations.data() + mOffsets[ 0 ];
+    }
+
     for( x = 1; x < width; x++ ) {
       score = mAP.gapOpenScore + x * mAP.gapExtendScore;
 
       if( score < -mAP.xDrop )
         break;
 
-      mOperations[ x ]   = CigarOp::Insertion;
+      if( rowOperations )
+        rowOperations[ x ] = CigarOp::Insertion;
+      if( rowCounts ) {
+        rowCounts[ x ].matches = 0;
+        rowCounts[ x ].cols    = x;
+      }
       mRow[ x ].score    = score;
       mRow[ x ].scoreGap = MinInt();
     }
+    if( rowCounts )
+      rowCounts[ 0 ] = CellCounts();
     size_t rowSize = x;
-    /* Print( mRow ); */
+    numOperations += rowSize;
 
     size_t firstX = 0;
 
@@ -115,12 +152,20 @@ public:
 
       size_t lastX = firstX;
 
+      // The row's cells from firstX on, up to the full width if the row
+      // gets extended
+      const size_t rowFirstX = firstX;
+      if( cigar ) {
+        reserveRow( rowFirstX );
+        rowOperations = mOperations.data() + mOffsets[ y ];
+      }
+
       for( x = firstX; x < rowSize; x++ ) {
         int colGap = mRow[ x ].scoreGap;
 
         aIdx = 0;
         bIdx = 0;
-        bool match;
+        bool match = false;
         if( x > 0 ) {
           // diagScore: score at col-1, row-1
 
@@ -132,7 +177,6 @@ public:
             bIdx = startB - y;
           }
 
-          /* printf( "x:%zu y:%zu %c == %c\n", x, y, A[ aIdx ], B[ bIdx ] ); */
           match = MatchPolicy< Alphabet >::Match( A[ aIdx ], B[ bIdx ] );
           score = diagScore + ScorePolicy< Alphabet >::Score( A[ aIdx ], B[ bIdx ] );
         }
@@ -150,6 +194,37 @@ public:
         // in the next iteration for the diagonal computation of (x, y )
         diagScore = mRow[ x ].score;
 
+        // Record the op, a traceback may pass here even if dropped
+        if( rowOperations ) {
+          CigarOp op;
+          if( score == rowGap ) {
+            op = CigarOp::Insertion;
+          } else if( score == colGap ) {
+            op = CigarOp::Deletion;
+          } else {
+            op = match ? CigarOp::Match : CigarOp::Mismatch;
+          }
+          rowOperations[ x ] = op;
+        }
+
+        // Or count along the cell the op would lead back to
+        if( rowCounts ) {
+          CellCounts cellCounts;
+          if( score == rowGap ) {
+            cellCounts = leftCounts;
+          } else if( score == colGap ) {
+            cellCounts = rowCounts[ x ];
+          } else {
+            cellCounts = diagCounts;
+            cellCounts.matches += match;
+          }
+          cellCounts.cols++;
+
+          diagCounts     = rowCounts[ x ];
+          rowCounts[ x ] = cellCounts;
+          leftCounts     = cellCounts;
+        }
+
         if( bestScore - score > mAP.xDrop ) {
           // X-Drop test failed
           mRow[ x ].score = MinInt();
@@ -172,19 +247,10 @@ public:
 
             bestX = x;
             bestY = y;
+            if( rowCounts )
+              bestCounts = rowCounts[ x ];
           }
 
-          // Record new score
-          CigarOp op;
-          if( score == rowGap ) {
-            op = CigarOp::Insertion;
-          } else if( score == colGap ) {
-            op = CigarOp::Deletion;
-          } else {
-            op = match ? CigarOp::Match : CigarOp::Mismatch;
-          }
-          mOperations[ y * width + x ] = op;
-
           mRow[ x ].score = score;
           mRow[ x ].scoreGap =
             std::max( score + mAP.gapOpenScore + mAP.gapExtendScore,
@@ -209,7 +275,12 @@ public:
           mRow[ rowSize ].score = rowGap;
           mRow[ rowSize ].scoreGap =
             rowGap + mAP.gapOpenScore + mAP.gapExtendScore;
-          mOperations[ y * width + rowSize ] = CigarOp::Insertion;
+          if( rowOperations )
+            rowOperations[ rowSize ] = CigarOp::Insertion;
+          if( rowCounts ) {
+            rowCounts[ rowSize ] = rowCounts[ rowSize - 1 ];
+            rowCounts[ rowSize ].cols++;
+          }
           rowGap += mAP.gapExtendScore;
           rowSize++;
         }
@@ -219,47 +290,78 @@ public:
       if( rowSize < width ) {
         mRow[ rowSize ].score    = MinInt();
         mRow[ rowSize ].scoreGap = MinInt();
+        if( rowOperations )
+          rowOperations[ rowSize ] = CigarOp::Insertion;
+        if( rowCounts ) {
+          rowCounts[ rowSize ] = rowCounts[ rowSize - 1 ];
+          rowCounts[ rowSize ].cols++;
+        }
         rowSize++;
       }
-      /* Print( mRow ); */
+
+      numOperations += rowSize - rowFirstX;
     }
 
     if( cigar ) {
-      size_t bx = bestX;
-      size_t by = bestY;
-
-      CigarEntry ce;
-      cigar->Clear();
-      while( bx != 0 || by != 0 ) {
-        CigarOp op = mOperations[ by * width + bx ];
-        cigar->Add( op );
-
-        switch( op ) {
-          case CigarOp::Insertion:
-            bx--;
-            break;
-          case CigarOp::Deletion:
-            by--;
-            break;
-          case CigarOp::Match:
-            bx--;
-            by--;
-            break;
-          case CigarOp::Mismatch:
-            bx--;
-            by--;
-            break;
-          default:
-            assert( true );
-            break;
-        }
-      }
+      Traceback( A, B, bestX, bestY, dir, startA, startB, cigar,
+                 [&]( const size_t bx, const size_t by ) {
+                   return mOperations[ mOffsets[ by ] + bx ];
+                 } );
+    }
+    if( counts ) {
+      counts->matches = bestCounts.matches;
+      counts->cols    = bestCounts.cols;
+      counts->endGap  = 0;
+    }
+
+    return bestScore;
+  }
 
-      if( dir == AlignmentDirection::Forward ) {
-        cigar->Reverse();
+private:
+  // From the best cell back to the start. Whether a diagonal move is a
+  // match is decided here.
+  template < typename OperationAt >
+  void Traceback( const Sequence< Alphabet >& A, const Sequence< Alphabet >& B,
+                  size_t bx, size_t by, const AlignmentDirection dir,
+                  const size_t startA, const size_t startB, Cigar* cigar,
+                  const OperationAt& operationAt ) const {
+    cigar->Clear();
+    while( bx != 0 || by != 0 ) {
+      CigarOp op = operationAt( bx, by );
+
+      switch( op ) {
+        case CigarOp::Insertion:
+          bx--;
+          break;
+        case CigarOp::Deletion:
+          by--;
+          break;
+        case CigarOp::Match:
+        case CigarOp::Mismatch:
+          if( dir == AlignmentDirection::Forward ) {
+            op = MatchPolicy< Alphabet >::Match( A[ startA + bx - 1 ],
+                                                 B[ startB + by - 1 ] )
+                   ? CigarOp::Match
+                   : CigarOp::Mismatch;
+          } else {
+            op = MatchPolicy< Alphabet >::Match( A[ startA - bx ],
+                                                 B[ startB - by ] )
+                   ? CigarOp::Match
+                   : CigarOp::Mismatch;
+          }
+          bx--;
+          by--;
+          break;
+        default:
+          assert( true );
+          break;
       }
+
+      cigar->Add( op );
     }
 
-    return bestScore;
-  };
-};
+    if( dir == AlignmentDirection::Forward ) {
+      cigar->Reverse();
+    }
+  }
+};
\ No newline at end of file
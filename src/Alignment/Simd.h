@@ -0,0 +1,24 @@
+#pragma once
+
+// Vector kernels are built for x86 with GCC or Clang only, through target
+// attributes (so no extra compiler flags are needed), and picked at runtime
+// by what the CPU supports. Everything else uses the scalar code.
+#if( defined( __x86_64__ ) || defined( __i386__ ) ) && \
+  ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+enum class SimdLevel { None, SSE41, AVX2 };
+
+inline SimdLevel SupportedSimdLevel() {
+#ifdef USE_X86_SIMD
+  static const SimdLevel level =
+    __builtin_cpu_supports( "avx2" )     ? SimdLevel::AVX2
+    : __builtin_cpu_supports( "sse4.1" ) ? SimdLevel::SSE41
+                                         : SimdLevel::None;
+  return level;
+#else
+  return SimdLevel::None;
+#endif
+}
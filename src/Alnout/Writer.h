@@ -157,10 +157,10 @@ private:
       const auto& fce = cigar.front();
       if( fce.op == CigarOp::Deletion ) {
         targetStart = fce.count;
-        cigar.pop_front();
+        cigar.erase( cigar.begin() );
       } else if( fce.op == CigarOp::Insertion ) {
         queryStart = fce.count;
-        cigar.pop_front();
+        cigar.erase( cigar.begin() );
       }
     }
 
@@ -36,10 +36,10 @@ public:
         const auto& fce = cigar.front();
         if( fce.op == CigarOp::Deletion ) {
           ts += fce.count;
-          cigar.pop_front();
+          cigar.erase( cigar.begin() );
         } else if( fce.op == CigarOp::Insertion ) {
           qs += fce.count;
-          cigar.pop_front();
+          cigar.erase( cigar.begin() );
         }
       }
 
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "Sequence.h"
@@ -9,10 +19,19 @@
 #include "Database/HSP.h"
 #include "Database/Highscore.h"
 #include "Database/Kmers.h"
+#include "Database/Minimizers.h"
+#include "Database/Storage.h"
+
+#include "Index/Reader.h"
+#include "Index/Writer.h"
 
 #include "Alphabet.h"
 
+#ifdef USE_16BIT_SEQUENCE_IDS
+using SequenceId = uint16_t; // Halves the postings, for less than 65535 sequences
+#else
 using SequenceId = uint32_t; // SequenceId
+#endif
 
 template < typename Alphabet >
 class Database {
@@ -21,38 +40,271 @@ public:
   using OnProgressCallback =
     std::function< void( ProgressType, const size_t, const size_t ) >;
 
+  // Dense kmer tables have an entry for every possible kmer, sparse ones
+  // only for the kmers present. Auto goes sparse for long kmers.
+  enum KmerTablePolicy { AutoKmerTable, DenseKmerTable, SparseKmerTable };
+
   Database( const size_t kmerLength );
 
+  // Seed used for indexing and lookup (replaces the contiguous kmer)
+  void SetSeedMask( const SeedMask& seedMask );
+  const SeedMask& GetSeedMask() const;
+
+  // Only index the minimizers of every window of consecutive kmers
+  // (1 = every kmer), shrinks the posting lists by about window / 2
+  void SetMinimizerWindow( const size_t window );
+  size_t GetMinimizerWindow() const;
+
   void SetProgressCallback( const OnProgressCallback& progressCallback );
+
+  // Number of threads used by Initialize (0 = one per core)
+  void SetNumThreads( const size_t numThreads );
+
+  // Store the posting lists delta + varint encoded (smaller, slower to read)
+  void SetCompressSequenceIds( const bool compress );
+
+  // Postings hold every occurrence of a kmer with its position, so seeds
+  // can be taken from the index (ForEachPositionOfKmer) instead of
+  // comparing the kmers of query and candidate. Can't be compressed.
+  void SetPositionalPostings( const bool positional );
+  bool HasPositionalPostings() const;
+
+  // Kmers found in more than maxSequences sequences are masked: they are
+  // not indexed and thus skipped when counting hits (0 = no limit). With
+  // positional postings the limit applies to occurrences.
+  void SetMaxKmerFrequency( const size_t maxSequences );
+  // Same with the limit at a percentile (0-100] of the kmer frequencies
+  void SetMaxKmerFrequencyPercentile( const double percentile );
+
+  void SetKmerTablePolicy( const KmerTablePolicy policy );
+  bool HasSparseKmerTable() const;
+
+  // Identical sequences are indexed once, under the first identifier.
+  // The identifiers of the copies are kept (ForEachDuplicateIdentifier).
+  // Appended copies are merged by Compact.
+  void SetDereplicate( const bool dereplicate );
+  bool IsDereplicated() const;
+
   void Initialize( const SequenceList< Alphabet >& sequences );
 
+  // Adds sequences without rebuilding the tables, they are indexed in a
+  // small secondary index (delta) which is searched alongside
+  void Append( const SequenceList< Alphabet >& sequences );
+
+  // Merges the delta into the main tables
+  void Compact();
+  size_t NumDeltaSequences() const;
+
+  // Persist the index, so it can be memory mapped by Load later on
+  void Save( const std::string& pathToFile ) const;
+  void Load( const std::string& pathToFile );
+
   size_t NumSequences() const;
   size_t KmerLength() const;
   size_t MaxUniqueKmers() const;
 
-  const Sequence< Alphabet >& GetSequenceById( const SequenceId& seqId ) const;
+  // Kmers masked by the frequency limit (sorted) and the number of
+  // sequences (occurrences, if positional) each of them was found in
+  size_t NumMaskedKmers() const;
+  bool GetMaskedKmers( const Kmer** kmers, const size_t** numSequences,
+                       size_t* numKmers ) const;
 
-  bool GetKmersForSequenceId( const SequenceId& seqId, const Kmer** kmers,
-                              size_t* numKmers ) const;
-  bool GetSequenceIdsIncludingKmer( const Kmer& kmer, const SequenceId** seqIds,
-                                    size_t* numSeqIds ) const;
+  // Sequences of a loaded index are read from the file into buffer, which
+  // the caller keeps (it doesn't allocate once it has grown)
+  const Sequence< Alphabet >& GetSequenceById( const SequenceId&     seqId,
+                                               Sequence< Alphabet >* buffer ) const;
+
+  // Identifiers of the copies of a sequence dropped by dereplication
+  template < typename Callback >
+  void ForEachDuplicateIdentifier( const SequenceId& seqId,
+                                   const Callback&   callback ) const;
+
+  // Kmers of a sequence (and their positions) as they are indexed (all
+  // or the minimizers), queries have to be sampled the same way
+  template < typename Callback >
+  void ForEachIndexedKmer( const Kmer* kmers, const size_t numKmers,
+                           const Callback& callback ) const;
+
+  template < typename Callback >
+  void ForEachSequenceIdIncludingKmer( const Kmer&     kmer,
+                                       const Callback& callback ) const;
+
+  // Size of the postings of a kmer (in entries, or bytes if compressed),
+  // how long going through them takes
+  size_t NumPostingsOfKmer( const Kmer& kmer ) const;
+
+  // Positions of a kmer in a sequence (ascending), positional postings only
+  template < typename Callback >
+  void ForEachPositionOfKmer( const Kmer& kmer, const SequenceId& seqId,
+                              const Callback& callback ) const;
 
 private:
+  enum IndexSection {
+    SectionIdentifiers,
+    SectionIdentifierOffsets,
+    SectionResidues,
+    SectionResidueOffsets,
+    SectionSequenceIds,
+    SectionSequenceIdsOffsetByKmer,
+    SectionSeedMask,
+    SectionSlotKmers,
+    SectionMaskedKmers,
+    SectionMaskedKmerCounts,
+    SectionDuplicateIdentifiers,
+    SectionDuplicateIdentifierOffsets,
+    SectionSequencePositions,
+  };
+
+  // Largest dense table (in bits of the kmer) picked automatically
+  static const size_t MaxDenseKmerBits = 24;
+  static const size_t NoSlot           = ( size_t )-1;
+  static const SequenceId NoSequenceId = ( SequenceId )-1;
+
+  // Tables produced by Initialize
+  struct IndexTables {
+    std::vector< SequenceId > sequenceIds;
+    std::vector< uint32_t >   positions; // positional postings only
+    std::vector< size_t >     sequenceIdsOffsetByKmer;
+  };
+
   OnProgressCallback mProgressCallback;
   SequenceList< Alphabet > mSequences;
 
-  std::vector< Kmer >   mKmers;
+  // A loaded index leaves its sequences in the file (and mSequences
+  // empty), item i of these spans [ offsets[ i ], offsets[ i + 1 ] ).
+  // The offsets are checked as the items are read.
+  Storage< char >   mMappedIdentifiers, mMappedResidues;
+  Storage< size_t > mMappedIdentifierOffsets, mMappedResidueOffsets;
+
+  // Identifiers of the copies of each sequence, empty if there are none.
+  // Those of a loaded index are newline terminated in mMappedDuplicates.
+  bool                                      mDereplicate;
+  std::vector< std::vector< std::string > > mDuplicateIdentifiers;
+  Storage< char >                           mMappedDuplicates;
+  Storage< size_t >                         mMappedDuplicateOffsets;
+
+  size_t mNumThreads;
+
+  SeedMask mSeedMask;
+  size_t   mMaxUniqueKmers;
+  size_t   mMinimizerWindow;
+
+  // Every kmer maps to a slot of the posting lists. Dense tables use the
+  // kmer itself, sparse tables look it up in an open addressing hash
+  // table of the kmers present (empty slots hold AmbiguousKmer).
+  KmerTablePolicy mKmerTablePolicy;
+  bool            mSparseKmers;
+  size_t          mNumSlots;
+  size_t          mSlotBits;
+  Storage< Kmer > mSlotKmers;
+
+  size_t            mMaxKmerFrequency;
+  double            mMaxKmerFrequencyPercentile;
+  Storage< Kmer >   mMaskedKmers;
+  Storage< size_t > mMaskedKmerCounts;
 
-  size_t mKmerLength;
-  size_t mMaxUniqueKmers;
+  // Posting lists in CSR layout, the list of slot k spans
+  // [ offset[ k ], offset[ k + 1 ] ) of either mSequenceIds or, if
+  // compressed, mCompressedSequenceIds. Offsets are 32-bit unless the
+  // lists outgrow them, only one of the two offset tables is in use.
+  // Positional postings have the positions alongside, in
+  // mSequencePositions.
+  bool                  mCompressSequenceIds;
+  bool                  mPositionalPostings;
+  Storage< SequenceId > mSequenceIds;
+  Storage< uint32_t >   mSequencePositions;
+  Storage< uint8_t >    mCompressedSequenceIds;
+  Storage< uint32_t >   mSequenceIdsOffsetByKmer32;
+  Storage< uint64_t >   mSequenceIdsOffsetByKmer64;
 
-  std::vector< SequenceId > mSequenceIds;
-  std::vector< size_t >     mSequenceIdsOffsetByKmer;
-  std::vector< size_t >     mSequenceIdsCountByKmer;
+  // Backing memory of tables loaded from an index file
+  std::shared_ptr< MappedFile > mMappedFile;
 
-  std::vector< size_t > mKmerOffsetBySequenceId;
-  std::vector< size_t > mKmerCountBySequenceId;
+  // Appended sequences, their ids follow those of mSequences
+  std::unique_ptr< Database< Alphabet > > mDelta;
 
+  size_t NumIndexingThreads() const;
+
+  void InitializeDense( const std::vector< SequenceId >& chunkBounds,
+                        IndexTables*                     tables );
+  void InitializeSparse( const std::vector< SequenceId >& chunkBounds,
+                         IndexTables*                     tables );
+  void BuildSparseKmerTable( const std::vector< Kmer >& distinctKmers );
+
+  template < typename Callback >
+  void ForEachSequenceIdInTables( const Kmer&     kmer,
+                                  const Callback& callback ) const;
+  // Every posting (id, position) of the main tables
+  template < typename Callback >
+  void ForEachPostingInTables( const Kmer&     kmer,
+                               const Callback& callback ) const;
+  bool PostingsOfKmer( const Kmer& kmer, size_t* begin, size_t* end ) const;
+
+  // Sequences of the main tables, in memory or in the file
+  size_t NumMainSequences() const;
+  size_t MainSequenceLength( const SequenceId seqId ) const;
+  const Sequence< Alphabet >& MainSequence( const SequenceId      seqId,
+                                            Sequence< Alphabet >* buffer ) const;
+  bool HasDuplicateIdentifiers() const;
+  void MaterializeSequences( SequenceList< Alphabet >* sequences,
+                             std::vector< std::vector< std::string > >*
+                               duplicateIdentifiers ) const;
+  void UnmapSequences();
+
+  // Item i of a section delimited by an offset table
+  static void MappedRange( const Storage< size_t >& offsets, const size_t size,
+                           const size_t i, size_t* begin, size_t* end ) {
+    *begin = offsets[ i ];
+    *end   = offsets[ i + 1 ];
+    if( *begin > *end || *end > size )
+      throw std::runtime_error( "The database index is corrupt" );
+  }
+
+  // Reads a varint (7 bits a byte, low bits first), false if it runs past
+  // dataEnd or 32 bits
+  static bool ReadVarint( const uint8_t** data, const uint8_t* dataEnd,
+                          uint32_t* value ) {
+    uint32_t v = 0;
+    for( int shift = 0; shift < 32; shift += 7 ) {
+      if( *data >= dataEnd )
+        return false;
+
+      uint8_t byte = *( *data )++;
+      v |= uint32_t( byte & 0x7F ) << shift;
+      if( !( byte & 0x80 ) ) {
+        *value = v;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void AddDereplicated( const SequenceList< Alphabet >& sequences,
+                        std::vector< SequenceId >*      ids );
+
+  using MaskedKmerList = std::vector< std::pair< Kmer, size_t > >;
+
+  void ApplyKmerStopList( IndexTables* tables, MaskedKmerList&& maskedKmers );
+  bool IsMaskedKmer( const Kmer kmer ) const;
+  size_t MaskedKmerCount( const Kmer kmer ) const;
+
+  size_t HashSlot( const Kmer kmer ) const;
+  Kmer KmerForSlot( const size_t slot ) const;
+  size_t SlotForKmer( const Kmer kmer ) const;
+
+  void AssignSequenceIds( IndexTables&& tables );
+
+  template < typename Work >
+  void ForEachChunkInParallel( const ProgressType type, const size_t numChunks,
+                               const size_t progressBegin,
+                               const size_t progressTotal, const Work& work );
+
+  template < typename T >
+  static void WriteSection( Index::Writer& writer, const IndexSection section,
+                            const Storage< T >& storage );
+  template < typename T >
+  static void MapSection( const Index::Reader& reader,
+                          const IndexSection section, Storage< T >* storage );
 };
 
 /*
@@ -61,10 +313,50 @@ private:
 template < typename A >
 Database< A >::Database( const size_t kmerLength )
   :  mProgressCallback( []( ProgressType, const size_t, const size_t ) {} ),
-     mKmerLength( kmerLength ),
-     mMaxUniqueKmers( 1 << ( BitMapPolicy< A >::NumBits * mKmerLength ) )
+     mDereplicate( false ),
+     mNumThreads( 0 ),
+     mSeedMask( kmerLength ),
+     mMinimizerWindow( 1 ),
+     mKmerTablePolicy( AutoKmerTable ),
+     mSparseKmers( false ),
+     mNumSlots( 0 ),
+     mSlotBits( 0 ),
+     mMaxKmerFrequency( 0 ),
+     mMaxKmerFrequencyPercentile( 0 ),
+     mCompressSequenceIds( false ),
+     mPositionalPostings( false )
 {
-  assert( BitMapPolicy< A >::NumBits * mKmerLength <= sizeof( Kmer ) * 8 );
+  SetSeedMask( mSeedMask );
+}
+
+template < typename A >
+void Database< A >::SetSeedMask( const SeedMask& seedMask ) {
+  // Keep clear of AmbiguousKmer
+  if( BitMapPolicy< A >::NumBits * seedMask.Weight() >= sizeof( Kmer ) * 8 )
+    throw std::runtime_error( "Seed mask " + seedMask.Pattern() +
+                              " has too many 1s" );
+
+  mSeedMask       = seedMask;
+  mMaxUniqueKmers = size_t( 1 )
+                    << ( BitMapPolicy< A >::NumBits * mSeedMask.Weight() );
+}
+
+template < typename A >
+const SeedMask& Database< A >::GetSeedMask() const {
+  return mSeedMask;
+}
+
+template < typename A >
+void Database< A >::SetMinimizerWindow( const size_t window ) {
+  if( window < 1 )
+    throw std::runtime_error( "Minimizer window must be at least 1" );
+
+  mMinimizerWindow = window;
+}
+
+template < typename A >
+size_t Database< A >::GetMinimizerWindow() const {
+  return mMinimizerWindow;
 }
 
 template < typename A >
@@ -73,102 +365,1330 @@ void Database< A >::SetProgressCallback(
   mProgressCallback = progressCallback;
 }
 
+template < typename A >
+void Database< A >::SetNumThreads( const size_t numThreads ) {
+  mNumThreads = numThreads;
+}
+
+template < typename A >
+void Database< A >::SetCompressSequenceIds( const bool compress ) {
+  mCompressSequenceIds = compress;
+}
+
+template < typename A >
+void Database< A >::SetPositionalPostings( const bool positional ) {
+  mPositionalPostings = positional;
+}
+
+template < typename A >
+bool Database< A >::HasPositionalPostings() const {
+  return mPositionalPostings;
+}
+
+template < typename A >
+void Database< A >::SetMaxKmerFrequency( const size_t maxSequences ) {
+  mMaxKmerFrequency = maxSequences;
+}
+
+template < typename A >
+void Database< A >::SetMaxKmerFrequencyPercentile( const double percentile ) {
+  if( percentile <= 0 || percentile > 100 )
+    throw std::runtime_error( "Kmer frequency percentile must be in (0, 100]" );
+
+  mMaxKmerFrequencyPercentile = percentile;
+}
+
+template < typename A >
+void Database< A >::SetKmerTablePolicy( const KmerTablePolicy policy ) {
+  mKmerTablePolicy = policy;
+}
+
+template < typename A >
+bool Database< A >::HasSparseKmerTable() const {
+  return mSparseKmers;
+}
+
+template < typename A >
+void Database< A >::SetDereplicate( const bool dereplicate ) {
+  mDereplicate = dereplicate;
+}
+
+template < typename A >
+bool Database< A >::IsDereplicated() const {
+  return mDereplicate;
+}
+
 template < typename A >
 void Database< A >::Initialize( const SequenceList< A >& sequences ) {
-  mSequences = sequences;
+  // The largest id is reserved as marker
+  if( sequences.size() >= std::numeric_limits< SequenceId >::max() )
+    throw std::runtime_error( "Too many database sequences, at most " +
+                              std::to_string( std::numeric_limits< SequenceId >::max() - 1 ) +
+                              " are supported" );
+
+  if( mPositionalPostings && mCompressSequenceIds )
+    throw std::runtime_error( "Positional postings can't be compressed" );
+
+  const size_t kmerBits = BitMapPolicy< A >::NumBits * mSeedMask.Weight();
+  if( mKmerTablePolicy == DenseKmerTable && kmerBits > MaxDenseKmerBits )
+    throw std::runtime_error( "Seed mask " + mSeedMask.Pattern() +
+                              " is too long for a dense kmer table" );
+
+  UnmapSequences();
+  mMappedFile.reset();
+  mDelta.reset();
+
+  mDuplicateIdentifiers.clear();
+  if( mDereplicate ) {
+    mSequences.clear();
+    std::vector< SequenceId > ids;
+    AddDereplicated( sequences, &ids );
+  } else {
+    mSequences = sequences;
+  }
+
+  const size_t numSequences = mSequences.size();
 
-  size_t totalEntries       = 0;
+  switch( mKmerTablePolicy ) {
+    case DenseKmerTable:
+      mSparseKmers = false;
+      break;
+
+    case SparseKmerTable:
+      mSparseKmers = true;
+      break;
+
+    default:
+      mSparseKmers = kmerBits > MaxDenseKmerBits;
+      break;
+  }
+
+  if( !mSparseKmers ) {
+    mNumSlots = mMaxUniqueKmers;
+    mSlotKmers.Assign( std::vector< Kmer >() );
+  }
+
+  // Split the sequences into contiguous chunks of similar total length,
+  // one per thread. Chunks are laid out in order of sequence id, so the
+  // resulting tables are identical to those of a serial build.
+  size_t numThreads = NumIndexingThreads();
+  size_t totalLength = 0;
+  for( auto& seq : mSequences )
+    totalLength += seq.Length();
+
+  std::vector< SequenceId > chunkBounds( 1, 0 );
+  size_t                    length = 0;
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    length += mSequences[ seqId ].Length();
+    if( seqId + 1 == numSequences ||
+        ( chunkBounds.size() < numThreads &&
+          length * numThreads >= totalLength * chunkBounds.size() ) ) {
+      chunkBounds.push_back( seqId + 1 );
+    }
+  }
+
+  IndexTables tables;
+  if( mSparseKmers )
+    InitializeSparse( chunkBounds, &tables );
+  else
+    InitializeDense( chunkBounds, &tables );
+
+  ApplyKmerStopList( &tables, MaskedKmerList() );
+
+  AssignSequenceIds( std::move( tables ) );
+}
+
+template < typename A >
+void Database< A >::Append( const SequenceList< A >& sequences ) {
+  // Nothing to append to yet
+  if( mNumSlots == 0 ) {
+    Initialize( sequences );
+    return;
+  }
+
+  if( NumSequences() + sequences.size() >=
+      std::numeric_limits< SequenceId >::max() )
+    throw std::runtime_error( "Too many database sequences, at most " +
+                              std::to_string( std::numeric_limits< SequenceId >::max() - 1 ) +
+                              " are supported" );
+
+  SequenceList< A > deltaSequences;
+  if( mDelta ) {
+    deltaSequences = mDelta->mSequences;
+  } else {
+    mDelta.reset( new Database< A >( mSeedMask.Span() ) );
+    mDelta->SetSeedMask( mSeedMask );
+    mDelta->SetMinimizerWindow( mMinimizerWindow );
+    mDelta->SetPositionalPostings( mPositionalPostings );
+    mDelta->SetKmerTablePolicy( mSparseKmers ? SparseKmerTable
+                                             : DenseKmerTable );
+  }
+  mDelta->SetNumThreads( mNumThreads );
+  mDelta->SetProgressCallback( mProgressCallback );
+
+  // Only the delta is rebuilt. It keeps copies, as it is rebuilt from
+  // its sequences; Compact merges them.
+  deltaSequences.insert( deltaSequences.end(), sequences.begin(),
+                         sequences.end() );
+  mDelta->Initialize( deltaSequences );
+}
+
+template < typename A >
+void Database< A >::Compact() {
+  if( !mDelta )
+    return;
+
+  Database< A > merged( mSeedMask.Span() );
+  merged.SetSeedMask( mSeedMask );
+  merged.mProgressCallback           = mProgressCallback;
+  merged.mNumThreads                 = mNumThreads;
+  merged.mMinimizerWindow            = mMinimizerWindow;
+  merged.mCompressSequenceIds        = mCompressSequenceIds;
+  merged.mKmerTablePolicy            = mKmerTablePolicy;
+  merged.mSparseKmers                = mSparseKmers;
+  merged.mMaxKmerFrequency           = mMaxKmerFrequency;
+  merged.mMaxKmerFrequencyPercentile = mMaxKmerFrequencyPercentile;
+  merged.mDereplicate                = mDereplicate;
+  merged.mPositionalPostings         = mPositionalPostings;
+
+  // New ids of the appended sequences, copies have none
+  MaterializeSequences( &merged.mSequences, &merged.mDuplicateIdentifiers );
+  std::vector< SequenceId > deltaIds;
+  if( mDereplicate ) {
+    merged.AddDereplicated( mDelta->mSequences, &deltaIds );
+  } else {
+    merged.mSequences.insert( merged.mSequences.end(),
+                              mDelta->mSequences.begin(),
+                              mDelta->mSequences.end() );
+    for( SequenceId seqId = 0; seqId < mDelta->mSequences.size(); seqId++ ) {
+      deltaIds.push_back( NumMainSequences() + seqId );
+    }
+  }
+
+  if( mSparseKmers ) {
+    std::vector< Kmer > distinctKmers[ 2 ];
+    const Storage< Kmer >* slotKmers[ 2 ] = { &mSlotKmers, &mDelta->mSlotKmers };
+    for( size_t i = 0; i < 2; i++ ) {
+      std::remove_copy( slotKmers[ i ]->data(),
+                        slotKmers[ i ]->data() + slotKmers[ i ]->size(),
+                        std::back_inserter( distinctKmers[ i ] ), AmbiguousKmer );
+      std::sort( distinctKmers[ i ].begin(), distinctKmers[ i ].end() );
+    }
+
+    std::vector< Kmer > both;
+    std::set_union( distinctKmers[ 0 ].begin(), distinctKmers[ 0 ].end(),
+                    distinctKmers[ 1 ].begin(), distinctKmers[ 1 ].end(),
+                    std::back_inserter( both ) );
+    merged.BuildSparseKmerTable( both );
+  } else {
+    merged.mNumSlots = mMaxUniqueKmers;
+  }
+
+  // The posting lists of both are concatenated (delta ids are the larger
+  // ones, so the lists stay sorted). Threads take a range of slots each.
+  // Masked kmers stay masked, the delta only adds to their count. Copies
+  // are left out, the lists include the sequence they are a copy of.
+  const size_t numChunks = merged.NumIndexingThreads();
+  std::vector< std::vector< SequenceId > > sequenceIdsByChunk( numChunks );
+  std::vector< std::vector< uint32_t > >   positionsByChunk( numChunks );
+  std::vector< MaskedKmerList >            maskedKmersByChunk( numChunks );
+  std::vector< size_t >                    countBySlot( merged.mNumSlots );
+
+  merged.ForEachChunkInParallel( ProgressType::Indexing, numChunks, 0,
+                                 merged.mNumSlots,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      const size_t begin = chunk * merged.mNumSlots / numChunks;
+      const size_t end   = ( chunk + 1 ) * merged.mNumSlots / numChunks;
+      auto&        ids       = sequenceIdsByChunk[ chunk ];
+      auto&        positions = positionsByChunk[ chunk ];
+
+      auto addPosting = [&]( const SequenceId seqId, const uint32_t pos ) {
+        ids.push_back( seqId );
+        if( mPositionalPostings )
+          positions.push_back( pos );
+      };
+
+      for( size_t slot = begin; slot < end; slot++ ) {
+        const Kmer   kmer   = merged.KmerForSlot( slot );
+        const size_t numIds = ids.size();
+
+        if( kmer != AmbiguousKmer && IsMaskedKmer( kmer ) ) {
+          size_t count = MaskedKmerCount( kmer );
+          mDelta->ForEachPostingInTables(
+            kmer, [&]( const SequenceId seqId, const uint32_t pos ) { count++; } );
+          maskedKmersByChunk[ chunk ].emplace_back( kmer, count );
+        } else if( kmer != AmbiguousKmer ) {
+          ForEachPostingInTables( kmer, addPosting );
+          mDelta->ForEachPostingInTables(
+            kmer, [&]( const SequenceId seqId, const uint32_t pos ) {
+              if( deltaIds[ seqId ] != NoSequenceId )
+                addPosting( deltaIds[ seqId ], pos );
+            } );
+        }
+
+        countBySlot[ slot ] = ids.size() - numIds;
+        ( *numProcessed )++;
+      }
+    } );
+
+  IndexTables tables;
+  tables.sequenceIdsOffsetByKmer.resize( merged.mNumSlots + 1 );
   size_t totalUniqueEntries = 0;
+  for( size_t slot = 0; slot < merged.mNumSlots; slot++ ) {
+    tables.sequenceIdsOffsetByKmer[ slot ] = totalUniqueEntries;
+    totalUniqueEntries += countBySlot[ slot ];
+  }
+  tables.sequenceIdsOffsetByKmer[ merged.mNumSlots ] = totalUniqueEntries;
 
-  /* std::vector< uint32_t > count( mMaxUniqueKmers ); */
-  std::vector< size_t >     uniqueCount( mMaxUniqueKmers );
-  std::vector< SequenceId > uniqueIndex( mMaxUniqueKmers, -1 );
+  tables.sequenceIds.reserve( totalUniqueEntries );
+  for( auto& ids : sequenceIdsByChunk ) {
+    tables.sequenceIds.insert( tables.sequenceIds.end(), ids.begin(),
+                               ids.end() );
+    std::vector< SequenceId >().swap( ids );
+  }
+
+  if( mPositionalPostings ) {
+    tables.positions.reserve( totalUniqueEntries );
+    for( auto& positions : positionsByChunk ) {
+      tables.positions.insert( tables.positions.end(), positions.begin(),
+                               positions.end() );
+      std::vector< uint32_t >().swap( positions );
+    }
+  }
+
+  MaskedKmerList maskedKmers;
+  for( auto& masked : maskedKmersByChunk ) {
+    maskedKmers.insert( maskedKmers.end(), masked.begin(), masked.end() );
+  }
+  merged.ApplyKmerStopList( &tables, std::move( maskedKmers ) );
+
+  merged.AssignSequenceIds( std::move( tables ) );
 
+  *this = std::move( merged );
+}
+
+// Adds the sequences not identical to one present, the identifiers of
+// the others are added to the one they are a copy of. ids receives the
+// id of every sequence added, NoSequenceId for copies.
+template < typename A >
+void Database< A >::AddDereplicated( const SequenceList< A >&   sequences,
+                                     std::vector< SequenceId >* ids ) {
+  std::hash< std::string >                      hash;
+  std::unordered_multimap< size_t, SequenceId > idsByHash;
   for( SequenceId seqId = 0; seqId < mSequences.size(); seqId++ ) {
-    const Sequence< A >& seq = mSequences[ seqId ];
+    idsByHash.emplace( hash( mSequences[ seqId ].sequence ), seqId );
+  }
 
-    Kmers< A > kmers( seq, mKmerLength );
-    kmers.ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      totalEntries++;
+  bool hasDuplicates = !mDuplicateIdentifiers.empty();
+  mDuplicateIdentifiers.resize( mSequences.size() );
 
-      // Count unique words
-      if( kmer == AmbiguousKmer || uniqueIndex[ kmer ] == seqId )
-        return;
+  ids->resize( sequences.size() );
+  for( size_t i = 0; i < sequences.size(); i++ ) {
+    const Sequence< A >& seq      = sequences[ i ];
+    const size_t         seqHash  = hash( seq.sequence );
+    SequenceId           original = NoSequenceId;
 
-      uniqueIndex[ kmer ] = seqId;
-      uniqueCount[ kmer ]++;
-      totalUniqueEntries++;
-    } );
+    auto range = idsByHash.equal_range( seqHash );
+    for( auto it = range.first; it != range.second; ++it ) {
+      if( mSequences[ it->second ].sequence == seq.sequence ) {
+        original = it->second;
+        break;
+      }
+    }
 
-    // Progress
-    if( seqId % 512 == 0 || seqId + 1 == mSequences.size() ) {
-      mProgressCallback( ProgressType::StatsCollection, seqId + 1,
-                         mSequences.size() );
+    if( original != NoSequenceId ) {
+      mDuplicateIdentifiers[ original ].push_back( seq.identifier );
+      ( *ids )[ i ] = NoSequenceId;
+      hasDuplicates = true;
+      continue;
     }
+
+    ( *ids )[ i ] = mSequences.size();
+    idsByHash.emplace( seqHash, mSequences.size() );
+    mSequences.push_back( seq );
+    mDuplicateIdentifiers.emplace_back();
   }
 
+  if( !hasDuplicates )
+    mDuplicateIdentifiers.clear();
+}
+
+template < typename A >
+size_t Database< A >::NumDeltaSequences() const {
+  return mDelta ? mDelta->NumSequences() : 0;
+}
+
+template < typename A >
+void Database< A >::InitializeDense(
+  const std::vector< SequenceId >& chunkBounds, IndexTables* tables ) {
+  const size_t numSequences = NumSequences();
+  const size_t numChunks    = chunkBounds.size() - 1;
+
+  auto& sequenceIds             = tables->sequenceIds;
+  auto& positions               = tables->positions;
+  auto& sequenceIdsOffsetByKmer = tables->sequenceIdsOffsetByKmer;
+
+  // Every chunk counts the unique words (or all occurrences, for
+  // positional postings) of its sequences separately
+  std::vector< std::vector< uint32_t > >   uniqueCountByChunk( numChunks );
+  std::vector< std::vector< SequenceId > > uniqueIndexByChunk( numChunks );
+
+  ForEachChunkInParallel( ProgressType::StatsCollection, numChunks, 0,
+                          numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      auto& uniqueCount = uniqueCountByChunk[ chunk ];
+      auto& uniqueIndex = uniqueIndexByChunk[ chunk ];
+      uniqueCount.assign( mNumSlots, 0 );
+      uniqueIndex.assign( mNumSlots, -1 );
+
+      std::vector< Kmer > kmersOfSequence;
+
+      for( SequenceId seqId = chunkBounds[ chunk ];
+           seqId < chunkBounds[ chunk + 1 ]; seqId++ ) {
+        kmersOfSequence.clear();
+
+        Kmers< A > kmers( mSequences[ seqId ], mSeedMask );
+        kmers.ForEach( [&]( const Kmer kmer, const size_t ) {
+          kmersOfSequence.push_back( kmer );
+        } );
+
+        // Count unique words
+        ForEachIndexedKmer( kmersOfSequence.data(), kmersOfSequence.size(),
+          [&]( const Kmer kmer, const size_t ) {
+            if( uniqueIndex[ kmer ] == seqId && !mPositionalPostings )
+              return;
+
+            uniqueIndex[ kmer ] = seqId;
+            uniqueCount[ kmer ]++;
+          } );
+
+        ( *numProcessed )++;
+      }
+    } );
+
   // Calculate indices
-  mSequenceIdsOffsetByKmer.resize( mMaxUniqueKmers );
-  for( size_t i = 0; i < mMaxUniqueKmers; i++ ) {
-    mSequenceIdsOffsetByKmer[ i ] =
-      i > 0 ? mSequenceIdsOffsetByKmer[ i - 1 ] + uniqueCount[ i - 1 ] : 0;
+  // The count of each chunk is turned into the position of the chunk's
+  // first entry relative to the beginning of the kmer's list
+  sequenceIdsOffsetByKmer.resize( mNumSlots + 1 );
+
+  size_t totalUniqueEntries = 0;
+  for( size_t kmer = 0; kmer < mNumSlots; kmer++ ) {
+    uint32_t count = 0;
+    for( auto& uniqueCount : uniqueCountByChunk ) {
+      uint32_t chunkCount = uniqueCount[ kmer ];
+      uniqueCount[ kmer ] = count;
+      count += chunkCount;
+    }
+
+    sequenceIdsOffsetByKmer[ kmer ] = totalUniqueEntries;
+    totalUniqueEntries += count;
   }
+  sequenceIdsOffsetByKmer[ mNumSlots ] = totalUniqueEntries;
 
   // Populate DB
-  mSequenceIds.resize( totalUniqueEntries );
-  mKmers.resize( totalEntries );
+  sequenceIds.resize( totalUniqueEntries );
+  if( mPositionalPostings )
+    positions.resize( totalUniqueEntries );
 
-  // Reset to 0
-  mSequenceIdsCountByKmer = std::vector< size_t >( mMaxUniqueKmers );
-  mKmerCountBySequenceId  = std::vector< size_t >( mSequences.size() );
-  mKmerOffsetBySequenceId = std::vector< size_t >( mSequences.size() );
+  ForEachChunkInParallel( ProgressType::Indexing, numChunks, 0, numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      auto& cursor      = uniqueCountByChunk[ chunk ];
+      auto& uniqueIndex = uniqueIndexByChunk[ chunk ];
+      std::fill( uniqueIndex.begin(), uniqueIndex.end(), SequenceId( -1 ) );
 
-  uniqueIndex = std::vector< SequenceId >( mMaxUniqueKmers, -1 );
+      std::vector< Kmer > kmersOfSequence;
 
-  auto   kmersData = mKmers.data();
-  size_t kmerCount = 0;
+      for( SequenceId seqId = chunkBounds[ chunk ];
+           seqId < chunkBounds[ chunk + 1 ]; seqId++ ) {
+        kmersOfSequence.clear();
 
-  for( SequenceId seqId = 0; seqId < mSequences.size(); seqId++ ) {
-    const Sequence< A >& seq = mSequences[ seqId ];
+        Kmers< A > kmers( mSequences[ seqId ], mSeedMask );
+        kmers.ForEach( [&]( const Kmer kmer, const size_t ) {
+          kmersOfSequence.push_back( kmer );
+        } );
 
-    mKmerOffsetBySequenceId[ seqId ] = kmerCount;
+        ForEachIndexedKmer( kmersOfSequence.data(), kmersOfSequence.size(),
+          [&]( const Kmer kmer, const size_t pos ) {
+            if( uniqueIndex[ kmer ] == seqId && !mPositionalPostings )
+              return;
 
-    Kmers< A > kmers( seq, mKmerLength );
-    kmers.ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      // Encode position in kmersData implicitly
-      // by saving _every_ kmer
-      kmersData[ kmerCount++ ] = kmer;
+            uniqueIndex[ kmer ] = seqId;
 
-      if( kmer == AmbiguousKmer || uniqueIndex[ kmer ] == seqId )
-        return;
+            const size_t index =
+              sequenceIdsOffsetByKmer[ kmer ] + cursor[ kmer ]++;
+            sequenceIds[ index ] = seqId;
+            if( mPositionalPostings )
+              positions[ index ] = pos;
+          } );
+
+        ( *numProcessed )++;
+      }
+    } );
+}
+
+template < typename A >
+void Database< A >::InitializeSparse(
+  const std::vector< SequenceId >& chunkBounds, IndexTables* tables ) {
+  const size_t numSequences = NumSequences();
+  const size_t numChunks    = chunkBounds.size() - 1;
 
-      uniqueIndex[ kmer ] = seqId;
+  auto& sequenceIds             = tables->sequenceIds;
+  auto& positions               = tables->positions;
+  auto& sequenceIdsOffsetByKmer = tables->sequenceIdsOffsetByKmer;
 
-      mSequenceIds[ mSequenceIdsOffsetByKmer[ kmer ] +
-                    mSequenceIdsCountByKmer[ kmer ] ] = seqId;
-      mSequenceIdsCountByKmer[ kmer ]++;
+  // The kmers of all sequences are only kept during the build
+  std::vector< Kmer >   kmersData;
+  std::vector< size_t > kmerOffsetBySequenceId( numSequences );
+  std::vector< size_t > kmerCountBySequenceId( numSequences );
+
+  size_t totalEntries = 0;
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    kmerOffsetBySequenceId[ seqId ] = totalEntries;
+    kmerCountBySequenceId[ seqId ] =
+      Kmers< A >( mSequences[ seqId ], mSeedMask ).Count();
+    totalEntries += kmerCountBySequenceId[ seqId ];
+  }
+  kmersData.resize( totalEntries );
+
+  // Extract the kmers and collect the distinct indexed ones of every chunk
+  std::vector< std::vector< Kmer > > distinctKmers( numChunks );
+
+  ForEachChunkInParallel( ProgressType::StatsCollection, numChunks, 0,
+                          2 * numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      auto& distinct = distinctKmers[ chunk ];
+
+      for( SequenceId seqId = chunkBounds[ chunk ];
+           seqId < chunkBounds[ chunk + 1 ]; seqId++ ) {
+        Kmer* kmersOfSequence =
+          kmersData.data() + kmerOffsetBySequenceId[ seqId ];
+
+        Kmers< A > kmers( mSequences[ seqId ], mSeedMask );
+        kmers.ForEach( [&]( const Kmer kmer, const size_t pos ) {
+          kmersOfSequence[ pos ] = kmer;
+        } );
+
+        ForEachIndexedKmer( kmersOfSequence, kmerCountBySequenceId[ seqId ],
+          [&]( const Kmer kmer, const size_t ) { distinct.push_back( kmer ); } );
+
+        ( *numProcessed )++;
+      }
+
+      std::sort( distinct.begin(), distinct.end() );
+      distinct.erase( std::unique( distinct.begin(), distinct.end() ),
+                      distinct.end() );
     } );
 
-    mKmerCountBySequenceId[ seqId ] =
-      kmerCount - mKmerOffsetBySequenceId[ seqId ];
+  while( distinctKmers.size() > 1 ) {
+    std::vector< std::vector< Kmer > > merged;
+    for( size_t i = 0; i + 1 < distinctKmers.size(); i += 2 ) {
+      auto& left  = distinctKmers[ i ];
+      auto& right = distinctKmers[ i + 1 ];
 
-    // Progress
-    if( seqId % 512 == 0 || seqId + 1 == mSequences.size() ) {
-      mProgressCallback( ProgressType::Indexing, seqId + 1, mSequences.size() );
+      std::vector< Kmer > both;
+      both.reserve( std::max( left.size(), right.size() ) );
+      std::set_union( left.begin(), left.end(), right.begin(), right.end(),
+                      std::back_inserter( both ) );
+      merged.push_back( std::move( both ) );
     }
+    if( distinctKmers.size() % 2 )
+      merged.push_back( std::move( distinctKmers.back() ) );
+
+    distinctKmers.swap( merged );
   }
+
+  BuildSparseKmerTable( distinctKmers.empty() ? std::vector< Kmer >()
+                                              : distinctKmers.front() );
+  distinctKmers.clear();
+
+  // The unique slots of every sequence (sorted) are kept in place of
+  // its kmers. Positional postings keep every occurrence, sorted by slot
+  // and position.
+  std::vector< size_t >   slotsData( totalEntries );
+  std::vector< uint32_t > positionsData( mPositionalPostings ? totalEntries : 0 );
+  std::vector< size_t >   slotCountBySequenceId( numSequences );
+
+  ForEachChunkInParallel( ProgressType::StatsCollection, numChunks,
+                          numSequences, 2 * numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      std::vector< std::pair< size_t, uint32_t > > occurrences;
+
+      for( SequenceId seqId = chunkBounds[ chunk ];
+           seqId < chunkBounds[ chunk + 1 ]; seqId++ ) {
+        const Kmer* kmersOfSequence =
+          kmersData.data() + kmerOffsetBySequenceId[ seqId ];
+        size_t* slots    = slotsData.data() + kmerOffsetBySequenceId[ seqId ];
+        size_t  numSlots = 0;
+
+        if( mPositionalPostings ) {
+          occurrences.clear();
+          ForEachIndexedKmer( kmersOfSequence, kmerCountBySequenceId[ seqId ],
+            [&]( const Kmer kmer, const size_t pos ) {
+              occurrences.emplace_back( SlotForKmer( kmer ), pos );
+            } );
+          std::sort( occurrences.begin(), occurrences.end() );
+
+          uint32_t* slotPositions =
+            positionsData.data() + kmerOffsetBySequenceId[ seqId ];
+          for( auto& occurrence : occurrences ) {
+            slots[ numSlots ]           = occurrence.first;
+            slotPositions[ numSlots++ ] = occurrence.second;
+          }
+        } else {
+          ForEachIndexedKmer( kmersOfSequence, kmerCountBySequenceId[ seqId ],
+            [&]( const Kmer kmer, const size_t ) {
+              slots[ numSlots++ ] = SlotForKmer( kmer );
+            } );
+          std::sort( slots, slots + numSlots );
+          numSlots = std::unique( slots, slots + numSlots ) - slots;
+        }
+
+        slotCountBySequenceId[ seqId ] = numSlots;
+        ( *numProcessed )++;
+      }
+    } );
+  std::vector< Kmer >().swap( kmersData );
+
+  // A table per thread would be as large as the dictionary, so the
+  // threads split up the slots instead. Each walks through all sequences
+  // in order, thus the lists come out sorted as in a dense build.
+  auto forEachSlotInRange = [&]( const size_t chunk,
+                                 std::atomic< size_t >* numProcessed,
+                                 const std::function< void( size_t, SequenceId, uint32_t ) >& block ) {
+    const size_t begin = chunk * mNumSlots / numChunks;
+    const size_t end   = ( chunk + 1 ) * mNumSlots / numChunks;
+
+    for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+      const size_t* slots = slotsData.data() + kmerOffsetBySequenceId[ seqId ];
+      const size_t* slotsEnd = slots + slotCountBySequenceId[ seqId ];
+
+      for( const size_t* slot = std::lower_bound( slots, slotsEnd, begin );
+           slot != slotsEnd && *slot < end; slot++ ) {
+        block( *slot, seqId,
+               mPositionalPostings ? positionsData[ slot - slotsData.data() ] : 0 );
+      }
+
+      ( *numProcessed )++;
+    }
+  };
+
+  std::vector< uint32_t > counts( mNumSlots );
+
+  ForEachChunkInParallel( ProgressType::Indexing, numChunks, 0,
+                          2 * numChunks * numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      forEachSlotInRange( chunk, numProcessed,
+        [&]( const size_t slot, const SequenceId, const uint32_t ) {
+          counts[ slot ]++;
+        } );
+    } );
+
+  // Calculate indices, counters become cursors
+  sequenceIdsOffsetByKmer.resize( mNumSlots + 1 );
+
+  size_t totalUniqueEntries = 0;
+  for( size_t slot = 0; slot < mNumSlots; slot++ ) {
+    sequenceIdsOffsetByKmer[ slot ] = totalUniqueEntries;
+    totalUniqueEntries += counts[ slot ];
+    counts[ slot ] = 0;
+  }
+  sequenceIdsOffsetByKmer[ mNumSlots ] = totalUniqueEntries;
+
+  // Populate DB
+  sequenceIds.resize( totalUniqueEntries );
+  if( mPositionalPostings )
+    positions.resize( totalUniqueEntries );
+
+  ForEachChunkInParallel( ProgressType::Indexing, numChunks,
+                          numChunks * numSequences,
+                          2 * numChunks * numSequences,
+    [&]( const size_t chunk, std::atomic< size_t >* numProcessed ) {
+      forEachSlotInRange( chunk, numProcessed,
+        [&]( const size_t slot, const SequenceId seqId, const uint32_t pos ) {
+          const size_t index = sequenceIdsOffsetByKmer[ slot ] + counts[ slot ]++;
+          sequenceIds[ index ] = seqId;
+          if( mPositionalPostings )
+            positions[ index ] = pos;
+        } );
+    } );
+}
+
+template < typename A >
+void Database< A >::BuildSparseKmerTable(
+  const std::vector< Kmer >& distinctKmers ) {
+  // Keep the load factor at or below 1/2
+  mSlotBits = 1;
+  while( ( size_t( 1 ) << mSlotBits ) < 2 * distinctKmers.size() ) {
+    mSlotBits++;
+  }
+  mNumSlots = size_t( 1 ) << mSlotBits;
+
+  std::vector< Kmer > slotKmers( mNumSlots, AmbiguousKmer );
+  for( auto kmer : distinctKmers ) {
+    size_t slot = HashSlot( kmer );
+    while( slotKmers[ slot ] != AmbiguousKmer ) {
+      slot = ( slot + 1 ) & ( mNumSlots - 1 );
+    }
+    slotKmers[ slot ] = kmer;
+  }
+
+  mSlotKmers.Assign( std::move( slotKmers ) );
+}
+
+// Masks the lists above the frequency limit, in addition to the kmers
+// masked already
+template < typename A >
+void Database< A >::ApplyKmerStopList( IndexTables* tables,
+                                       MaskedKmerList&& maskedKmers ) {
+  auto& sequenceIds             = tables->sequenceIds;
+  auto& positions               = tables->positions;
+  auto& sequenceIdsOffsetByKmer = tables->sequenceIdsOffsetByKmer;
+
+  size_t maxFrequency = mMaxKmerFrequency;
+  if( mMaxKmerFrequencyPercentile > 0 ) {
+    std::vector< size_t > frequencies;
+    for( size_t slot = 0; slot < mNumSlots; slot++ ) {
+      const size_t count =
+        sequenceIdsOffsetByKmer[ slot + 1 ] - sequenceIdsOffsetByKmer[ slot ];
+      if( count > 0 )
+        frequencies.push_back( count );
+    }
+    for( auto& masked : maskedKmers ) {
+      frequencies.push_back( masked.second );
+    }
+
+    if( !frequencies.empty() ) {
+      const size_t rank =
+        std::min( frequencies.size() - 1,
+                  size_t( frequencies.size() * mMaxKmerFrequencyPercentile / 100 ) );
+      std::nth_element( frequencies.begin(), frequencies.begin() + rank,
+                        frequencies.end() );
+      if( maxFrequency == 0 || frequencies[ rank ] < maxFrequency )
+        maxFrequency = frequencies[ rank ];
+    }
+  }
+
+  if( maxFrequency > 0 ) {
+    // Drop the masked lists in place
+    size_t numIds = 0;
+    size_t begin  = 0;
+    for( size_t slot = 0; slot < mNumSlots; slot++ ) {
+      const size_t end = sequenceIdsOffsetByKmer[ slot + 1 ];
+      sequenceIdsOffsetByKmer[ slot ] = numIds;
+
+      if( end - begin > maxFrequency ) {
+        maskedKmers.emplace_back( KmerForSlot( slot ), end - begin );
+      } else {
+        std::copy( sequenceIds.begin() + begin, sequenceIds.begin() + end,
+                   sequenceIds.begin() + numIds );
+        if( !positions.empty() )
+          std::copy( positions.begin() + begin, positions.begin() + end,
+                     positions.begin() + numIds );
+        numIds += end - begin;
+      }
+      begin = end;
+    }
+    sequenceIdsOffsetByKmer[ mNumSlots ] = numIds;
+    sequenceIds.resize( numIds );
+    if( !positions.empty() )
+      positions.resize( numIds );
+  }
+
+  std::sort( maskedKmers.begin(), maskedKmers.end() );
+
+  std::vector< Kmer >   kmers( maskedKmers.size() );
+  std::vector< size_t > counts( maskedKmers.size() );
+  for( size_t i = 0; i < maskedKmers.size(); i++ ) {
+    kmers[ i ]  = maskedKmers[ i ].first;
+    counts[ i ] = maskedKmers[ i ].second;
+  }
+  mMaskedKmers.Assign( std::move( kmers ) );
+  mMaskedKmerCounts.Assign( std::move( counts ) );
+}
+
+template < typename A >
+bool Database< A >::IsMaskedKmer( const Kmer kmer ) const {
+  return std::binary_search( mMaskedKmers.data(),
+                             mMaskedKmers.data() + mMaskedKmers.size(), kmer );
+}
+
+template < typename A >
+size_t Database< A >::MaskedKmerCount( const Kmer kmer ) const {
+  const Kmer* end = mMaskedKmers.data() + mMaskedKmers.size();
+  const Kmer* it  = std::lower_bound( mMaskedKmers.data(), end, kmer );
+  return it != end && *it == kmer ? mMaskedKmerCounts[ it - mMaskedKmers.data() ]
+                                  : 0;
+}
+
+template < typename A >
+size_t Database< A >::NumMaskedKmers() const {
+  return mMaskedKmers.size();
+}
+
+template < typename A >
+bool Database< A >::GetMaskedKmers( const Kmer**   kmers,
+                                    const size_t** numSequences,
+                                    size_t*        numKmers ) const {
+  *kmers        = mMaskedKmers.data();
+  *numSequences = mMaskedKmerCounts.data();
+  *numKmers     = mMaskedKmers.size();
+  return *numKmers > 0;
+}
+
+template < typename A >
+inline Kmer Database< A >::KmerForSlot( const size_t slot ) const {
+  return mSparseKmers ? mSlotKmers[ slot ] : Kmer( slot );
+}
+
+template < typename A >
+inline size_t Database< A >::HashSlot( const Kmer kmer ) const {
+  // Fibonacci hashing, the upper bits are the well mixed ones
+  return ( kmer * 0x9E3779B97F4A7C15ULL ) >> ( 64 - mSlotBits );
+}
+
+// Not to be called with AmbiguousKmer (which marks empty slots)
+template < typename A >
+inline size_t Database< A >::SlotForKmer( const Kmer kmer ) const {
+  if( !mSparseKmers )
+    return kmer < mNumSlots ? kmer : NoSlot;
+
+  const Kmer* slotKmers = mSlotKmers.data();
+  for( size_t slot = HashSlot( kmer );; slot = ( slot + 1 ) & ( mNumSlots - 1 ) ) {
+    if( slotKmers[ slot ] == kmer )
+      return slot;
+    if( slotKmers[ slot ] == AmbiguousKmer )
+      return NoSlot;
+  }
+}
+
+template < typename A >
+void Database< A >::AssignSequenceIds( IndexTables&& tables ) {
+  auto& sequenceIds = tables.sequenceIds;
+  auto& offsets     = tables.sequenceIdsOffsetByKmer;
+
+  mSequencePositions.Assign( std::move( tables.positions ) );
+
+  if( mCompressSequenceIds ) {
+    // Store the gaps between the (ascending) ids of each list as varints,
+    // offsets then refer to bytes
+    std::vector< uint8_t > bytes;
+    bytes.reserve( sequenceIds.size() );
+
+    size_t begin = 0;
+    for( size_t slot = 0; slot < mNumSlots; slot++ ) {
+      size_t end      = offsets[ slot + 1 ];
+      offsets[ slot ] = bytes.size();
+
+      SequenceId last = 0;
+      for( size_t i = begin; i < end; i++ ) {
+        uint32_t delta = sequenceIds[ i ] - last;
+        last           = sequenceIds[ i ];
+
+        while( delta >= 0x80 ) {
+          bytes.push_back( ( delta & 0x7F ) | 0x80 );
+          delta >>= 7;
+        }
+        bytes.push_back( delta );
+      }
+
+      begin = end;
+    }
+    offsets[ mNumSlots ] = bytes.size();
+
+    mCompressedSequenceIds.Assign( std::move( bytes ) );
+    mSequenceIds.Assign( std::vector< SequenceId >() );
+  } else {
+    mSequenceIds.Assign( std::move( sequenceIds ) );
+    mCompressedSequenceIds.Assign( std::vector< uint8_t >() );
+  }
+
+  if( offsets.back() <= std::numeric_limits< uint32_t >::max() ) {
+    mSequenceIdsOffsetByKmer32.Assign(
+      std::vector< uint32_t >( offsets.begin(), offsets.end() ) );
+    mSequenceIdsOffsetByKmer64.Assign( std::vector< uint64_t >() );
+  } else {
+    mSequenceIdsOffsetByKmer64.Assign(
+      std::vector< uint64_t >( offsets.begin(), offsets.end() ) );
+    mSequenceIdsOffsetByKmer32.Assign( std::vector< uint32_t >() );
+  }
+}
+
+template < typename A >
+size_t Database< A >::NumIndexingThreads() const {
+  size_t numThreads =
+    mNumThreads > 0 ? mNumThreads : std::thread::hardware_concurrency();
+
+  // For dense tables each thread keeps two tables with an entry for
+  // every possible kmer, don't let them blow up memory
+  if( !mSparseKmers ) {
+    const size_t maxTableBytes = 512 * 1024 * 1024;
+    const size_t tableBytes =
+      mNumSlots * ( sizeof( uint32_t ) + sizeof( SequenceId ) );
+    numThreads = std::min( numThreads, maxTableBytes / tableBytes );
+  }
+
+  // Not worth spinning up threads for a handful of sequences
+  const size_t minSequencesPerThread = 256;
+  numThreads = std::min( numThreads, NumSequences() / minSequencesPerThread );
+
+  return std::max< size_t >( numThreads, 1 );
+}
+
+template < typename A >
+template < typename Work >
+void Database< A >::ForEachChunkInParallel( const ProgressType type,
+                                            const size_t       numChunks,
+                                            const size_t       progressBegin,
+                                            const size_t       progressTotal,
+                                            const Work&        work ) {
+  std::atomic< size_t >   numProcessed( 0 );
+  size_t                  numDone = 0;
+  std::mutex              mutex;
+  std::condition_variable condition;
+
+  // What a chunk (or starting its thread, or reporting progress) threw is
+  // rethrown on the calling thread once every thread has been joined, so
+  // it reaches the caller instead of terminating the process
+  std::vector< std::exception_ptr > errors( numChunks + 1 );
+  std::exception_ptr&               error = errors.back();
+
+  std::vector< std::thread > threads;
+  try {
+    for( size_t chunk = 0; chunk < numChunks; chunk++ ) {
+      threads.emplace_back( [&, chunk]() {
+        try {
+          work( chunk, &numProcessed );
+        } catch( ... ) {
+          errors[ chunk ] = std::current_exception();
+        }
+
+        std::unique_lock< std::mutex > lock( mutex );
+        numDone++;
+        condition.notify_one();
+      } );
+    }
+  } catch( ... ) {
+    error = std::current_exception();
+  }
+
+  // Report progress from the calling thread only
+  {
+    std::unique_lock< std::mutex > lock( mutex );
+    while( numDone < threads.size() ) {
+      condition.wait_for( lock, std::chrono::milliseconds( 50 ) );
+      if( error )
+        continue;
+
+      try {
+        mProgressCallback( type, progressBegin + numProcessed, progressTotal );
+      } catch( ... ) {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  for( auto& thread : threads ) {
+    thread.join();
+  }
+
+  if( error )
+    std::rethrow_exception( error );
+  for( auto& chunkError : errors ) {
+    if( chunkError )
+      std::rethrow_exception( chunkError );
+  }
+}
+
+template < typename A >
+void Database< A >::Save( const std::string& pathToFile ) const {
+  if( mDelta )
+    throw std::runtime_error( "Compact the database before saving it" );
+
+  Index::Writer writer( pathToFile );
+
+  Index::Header& header  = writer.GetHeader();
+  header.alphabetBits    = BitMapPolicy< A >::NumBits;
+  header.kmerBytes       = sizeof( Kmer );
+  header.sequenceIdBytes = sizeof( SequenceId );
+  header.offsetBytes     = sizeof( size_t );
+  header.kmerLength      = mSeedMask.Span();
+  header.numSequences    = NumMainSequences();
+  header.minimizerWindow    = mMinimizerWindow;
+  header.dereplicated       = mDereplicate;
+  header.positionalPostings = mPositionalPostings;
+
+  header.kmerTable =
+    mSparseKmers ? Index::SparseKmerTable : Index::DenseKmerTable;
+  header.sequenceIdsOffsetBytes = mSequenceIdsOffsetByKmer64.empty() ? 4 : 8;
+  header.sequenceIdsEncoding    = mCompressSequenceIds
+                                    ? Index::SequenceIdsDeltaVarint
+                                    : Index::SequenceIdsPlain;
+
+  // Sequences are stored back to back, delimited by offset tables
+  std::string           identifiers, residues;
+  std::vector< size_t > identifierOffsets( 1, 0 ), residueOffsets( 1, 0 );
+  Sequence< A >         buffer;
+  for( SequenceId seqId = 0; seqId < header.numSequences; seqId++ ) {
+    const Sequence< A >& seq = MainSequence( seqId, &buffer );
+    identifiers += seq.identifier;
+    residues += seq.sequence;
+    identifierOffsets.push_back( identifiers.size() );
+    residueOffsets.push_back( residues.size() );
+  }
+
+  writer.Write( SectionIdentifiers, identifiers.data(), identifiers.size() );
+  writer.Write( SectionIdentifierOffsets, identifierOffsets.data(),
+                identifierOffsets.size() );
+  writer.Write( SectionResidues, residues.data(), residues.size() );
+  writer.Write( SectionResidueOffsets, residueOffsets.data(),
+                residueOffsets.size() );
+
+  writer.Write( SectionSeedMask, mSeedMask.Pattern().data(),
+                mSeedMask.Pattern().size() );
+
+  if( mSparseKmers )
+    WriteSection( writer, SectionSlotKmers, mSlotKmers );
+
+  if( mCompressSequenceIds )
+    WriteSection( writer, SectionSequenceIds, mCompressedSequenceIds );
+  else
+    WriteSection( writer, SectionSequenceIds, mSequenceIds );
+
+  if( mSequenceIdsOffsetByKmer64.empty() )
+    WriteSection( writer, SectionSequenceIdsOffsetByKmer,
+                  mSequenceIdsOffsetByKmer32 );
+  else
+    WriteSection( writer, SectionSequenceIdsOffsetByKmer,
+                  mSequenceIdsOffsetByKmer64 );
+
+  WriteSection( writer, SectionSequencePositions, mSequencePositions );
+  WriteSection( writer, SectionMaskedKmers, mMaskedKmers );
+  WriteSection( writer, SectionMaskedKmerCounts, mMaskedKmerCounts );
+
+  // The copies of every sequence are delimited by a per sequence offset
+  // table, their identifiers are newline terminated
+  std::string           duplicates;
+  std::vector< size_t > duplicateOffsets;
+  if( HasDuplicateIdentifiers() ) {
+    duplicateOffsets.push_back( 0 );
+    for( SequenceId seqId = 0; seqId < header.numSequences; seqId++ ) {
+      ForEachDuplicateIdentifier( seqId, [&]( const std::string& identifier ) {
+        duplicates += identifier;
+        duplicates += '\n';
+      } );
+      duplicateOffsets.push_back( duplicates.size() );
+    }
+  }
+
+  writer.Write( SectionDuplicateIdentifiers, duplicates.data(),
+                duplicates.size() );
+  writer.Write( SectionDuplicateIdentifierOffsets, duplicateOffsets.data(),
+                duplicateOffsets.size() );
+
+  writer.Finish();
+}
+
+template < typename A >
+void Database< A >::Load( const std::string& pathToFile ) {
+  Index::Reader reader( pathToFile );
+  mDelta.reset();
+
+  const Index::Header& header = reader.GetHeader();
+  if( header.alphabetBits != BitMapPolicy< A >::NumBits )
+    throw std::runtime_error( pathToFile +
+                              " was built for a different alphabet" );
+  if( header.kmerBytes != sizeof( Kmer ) ||
+      header.sequenceIdBytes != sizeof( SequenceId ) ||
+      header.offsetBytes != sizeof( size_t ) )
+    throw std::runtime_error( pathToFile +
+                              " was built on an incompatible platform" );
+
+  size_t      seedMaskSize;
+  const char* seedMask = reader.Get< char >( SectionSeedMask, &seedMaskSize );
+  SetSeedMask( SeedMask( std::string( seedMask, seedMaskSize ) ) );
+  if( header.minimizerWindow < 1 )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+  mMinimizerWindow = header.minimizerWindow;
+
+  // Nothing is copied or walked in full, loading costs about as much as
+  // mapping the file. Only the sizes are checked here, the offsets and
+  // postings where they are read.
+  const size_t numSequences = header.numSequences;
+  if( numSequences >= std::numeric_limits< SequenceId >::max() )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  // The offsets of numSequences items span the whole section
+  auto areValidOffsets = [&]( const Storage< size_t >& offsets,
+                              const size_t             size ) {
+    return offsets.size() == numSequences + 1 && offsets[ 0 ] == 0 &&
+           offsets[ numSequences ] == size;
+  };
+
+  mSequences.clear();
+  MapSection( reader, SectionIdentifiers, &mMappedIdentifiers );
+  MapSection( reader, SectionIdentifierOffsets, &mMappedIdentifierOffsets );
+  MapSection( reader, SectionResidues, &mMappedResidues );
+  MapSection( reader, SectionResidueOffsets, &mMappedResidueOffsets );
+  if( !areValidOffsets( mMappedIdentifierOffsets, mMappedIdentifiers.size() ) ||
+      !areValidOffsets( mMappedResidueOffsets, mMappedResidues.size() ) )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  switch( header.kmerTable ) {
+    case Index::DenseKmerTable:
+      if( BitMapPolicy< A >::NumBits * mSeedMask.Weight() > MaxDenseKmerBits )
+        throw std::runtime_error( pathToFile + " is corrupt" );
+      mSparseKmers = false;
+      mNumSlots    = mMaxUniqueKmers;
+      mSlotKmers.Assign( std::vector< Kmer >() );
+      break;
+
+    case Index::SparseKmerTable:
+      mSparseKmers = true;
+      MapSection( reader, SectionSlotKmers, &mSlotKmers );
+      mNumSlots = mSlotKmers.size();
+      for( mSlotBits = 1; ( size_t( 1 ) << mSlotBits ) < mNumSlots; mSlotBits++ )
+        ;
+      // Lookups probe up to an empty slot
+      if( mNumSlots < 2 || mNumSlots != ( size_t( 1 ) << mSlotBits ) ||
+          std::find( mSlotKmers.data(), mSlotKmers.data() + mNumSlots,
+                     AmbiguousKmer ) == mSlotKmers.data() + mNumSlots )
+        throw std::runtime_error( pathToFile + " is corrupt" );
+      break;
+
+    default:
+      throw std::runtime_error( pathToFile + " is corrupt" );
+  }
+
+  size_t numPostings;
+  switch( header.sequenceIdsEncoding ) {
+    case Index::SequenceIdsPlain:
+      mCompressSequenceIds = false;
+      MapSection( reader, SectionSequenceIds, &mSequenceIds );
+      mCompressedSequenceIds.Assign( std::vector< uint8_t >() );
+      numPostings = mSequenceIds.size();
+      break;
+
+    case Index::SequenceIdsDeltaVarint:
+      mCompressSequenceIds = true;
+      MapSection( reader, SectionSequenceIds, &mCompressedSequenceIds );
+      mSequenceIds.Assign( std::vector< SequenceId >() );
+      numPostings = mCompressedSequenceIds.size();
+      break;
+
+    default:
+      throw std::runtime_error( pathToFile + " is corrupt" );
+  }
+
+  size_t numOffsets;
+  switch( header.sequenceIdsOffsetBytes ) {
+    case 4:
+      MapSection( reader, SectionSequenceIdsOffsetByKmer,
+                  &mSequenceIdsOffsetByKmer32 );
+      mSequenceIdsOffsetByKmer64.Assign( std::vector< uint64_t >() );
+      numOffsets = mSequenceIdsOffsetByKmer32.size();
+      break;
+
+    case 8:
+      MapSection( reader, SectionSequenceIdsOffsetByKmer,
+                  &mSequenceIdsOffsetByKmer64 );
+      mSequenceIdsOffsetByKmer32.Assign( std::vector< uint32_t >() );
+      numOffsets = mSequenceIdsOffsetByKmer64.size();
+      break;
+
+    default:
+      throw std::runtime_error( pathToFile + " is corrupt" );
+  }
+
+  if( numOffsets != mNumSlots + 1 )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  size_t firstOffset, lastOffset;
+  if( mSequenceIdsOffsetByKmer64.empty() ) {
+    firstOffset = mSequenceIdsOffsetByKmer32[ 0 ];
+    lastOffset  = mSequenceIdsOffsetByKmer32[ mNumSlots ];
+  } else {
+    firstOffset = mSequenceIdsOffsetByKmer64[ 0 ];
+    lastOffset  = mSequenceIdsOffsetByKmer64[ mNumSlots ];
+  }
+  if( firstOffset != 0 || lastOffset != numPostings )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  mPositionalPostings = header.positionalPostings;
+  MapSection( reader, SectionSequencePositions, &mSequencePositions );
+  if( mPositionalPostings &&
+      ( mCompressSequenceIds || mSequencePositions.size() != numPostings ) )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  // Masked kmers are binary searched, they have to ascend (there are few)
+  MapSection( reader, SectionMaskedKmers, &mMaskedKmers );
+  MapSection( reader, SectionMaskedKmerCounts, &mMaskedKmerCounts );
+  if( mMaskedKmers.size() != mMaskedKmerCounts.size() )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+  for( size_t i = 1; i < mMaskedKmers.size(); i++ ) {
+    if( mMaskedKmers[ i - 1 ] >= mMaskedKmers[ i ] )
+      throw std::runtime_error( pathToFile + " is corrupt" );
+  }
+
+  mDereplicate = header.dereplicated;
+  mDuplicateIdentifiers.clear();
+  MapSection( reader, SectionDuplicateIdentifiers, &mMappedDuplicates );
+  MapSection( reader, SectionDuplicateIdentifierOffsets,
+              &mMappedDuplicateOffsets );
+  if( !mMappedDuplicateOffsets.empty() &&
+      !areValidOffsets( mMappedDuplicateOffsets, mMappedDuplicates.size() ) )
+    throw std::runtime_error( pathToFile + " is corrupt" );
+
+  mMappedFile = reader.File();
+}
+
+template < typename A >
+template < typename T >
+void Database< A >::WriteSection( Index::Writer&      writer,
+                                  const IndexSection  section,
+                                  const Storage< T >& storage ) {
+  writer.Write( section, storage.data(), storage.size() );
+}
+
+template < typename A >
+template < typename T >
+void Database< A >::MapSection( const Index::Reader& reader,
+                                const IndexSection section,
+                                Storage< T >*      storage ) {
+  size_t   count;
+  const T* data = reader.Get< T >( section, &count );
+  storage->Map( data, count );
 }
 
 template < typename A >
 const Sequence< A >&
-Database< A >::GetSequenceById( const SequenceId& seqId ) const {
+Database< A >::GetSequenceById( const SequenceId& seqId,
+                                Sequence< A >*    buffer ) const {
   assert( seqId < NumSequences() );
-  return mSequences[ seqId ];
+  const size_t numMainSequences = NumMainSequences();
+  if( seqId >= numMainSequences )
+    return mDelta->GetSequenceById( seqId - numMainSequences, buffer );
+
+  return MainSequence( seqId, buffer );
+}
+
+template < typename A >
+template < typename Callback >
+void Database< A >::ForEachDuplicateIdentifier( const SequenceId& seqId,
+                                                const Callback&   callback ) const {
+  const size_t numMainSequences = NumMainSequences();
+  if( seqId >= numMainSequences ) {
+    mDelta->ForEachDuplicateIdentifier( seqId - numMainSequences, callback );
+    return;
+  }
+
+  if( seqId < mDuplicateIdentifiers.size() ) {
+    for( auto& identifier : mDuplicateIdentifiers[ seqId ] ) {
+      callback( identifier );
+    }
+    return;
+  }
+
+  if( mMappedDuplicateOffsets.empty() )
+    return;
+
+  size_t begin, end;
+  MappedRange( mMappedDuplicateOffsets, mMappedDuplicates.size(), seqId,
+               &begin, &end );
+  const char* duplicates = mMappedDuplicates.data();
+  while( begin < end ) {
+    const char* newline =
+      ( const char* )memchr( duplicates + begin, '\n', end - begin );
+    if( !newline )
+      throw std::runtime_error( "The database index is corrupt" );
+
+    callback( std::string( duplicates + begin, newline ) );
+    begin = newline - duplicates + 1;
+  }
 }
 
 template < typename A >
 size_t Database< A >::NumSequences() const {
-  return mSequences.size();
+  return NumMainSequences() + NumDeltaSequences();
+}
+
+template < typename A >
+size_t Database< A >::NumMainSequences() const {
+  return mMappedResidueOffsets.empty() ? mSequences.size()
+                                       : mMappedResidueOffsets.size() - 1;
+}
+
+template < typename A >
+size_t Database< A >::MainSequenceLength( const SequenceId seqId ) const {
+  if( mMappedResidueOffsets.empty() )
+    return mSequences[ seqId ].Length();
+
+  size_t begin, end;
+  MappedRange( mMappedResidueOffsets, mMappedResidues.size(), seqId, &begin,
+               &end );
+  return end - begin;
+}
+
+template < typename A >
+const Sequence< A >&
+Database< A >::MainSequence( const SequenceId seqId,
+                             Sequence< A >*   buffer ) const {
+  if( mMappedResidueOffsets.empty() )
+    return mSequences[ seqId ];
+
+  size_t begin, end;
+  MappedRange( mMappedIdentifierOffsets, mMappedIdentifiers.size(), seqId,
+               &begin, &end );
+  buffer->identifier.assign( mMappedIdentifiers.data() + begin, end - begin );
+  MappedRange( mMappedResidueOffsets, mMappedResidues.size(), seqId, &begin,
+               &end );
+  buffer->sequence.assign( mMappedResidues.data() + begin, end - begin );
+  buffer->quality.clear();
+  return *buffer;
+}
+
+template < typename A >
+bool Database< A >::HasDuplicateIdentifiers() const {
+  return !mDuplicateIdentifiers.empty() || !mMappedDuplicateOffsets.empty();
+}
+
+// Copies of the main sequences and their duplicate identifiers, for
+// rebuilding the tables
+template < typename A >
+void Database< A >::MaterializeSequences(
+  SequenceList< A >*                         sequences,
+  std::vector< std::vector< std::string > >* duplicateIdentifiers ) const {
+  if( mMappedResidueOffsets.empty() ) {
+    *sequences            = mSequences;
+    *duplicateIdentifiers = mDuplicateIdentifiers;
+    return;
+  }
+
+  const size_t numSequences = NumMainSequences();
+  sequences->resize( numSequences );
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    MainSequence( seqId, &( *sequences )[ seqId ] );
+  }
+
+  duplicateIdentifiers->clear();
+  if( !HasDuplicateIdentifiers() )
+    return;
+
+  duplicateIdentifiers->resize( numSequences );
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    ForEachDuplicateIdentifier( seqId, [&]( const std::string& identifier ) {
+      ( *duplicateIdentifiers )[ seqId ].push_back( identifier );
+    } );
+  }
+}
+
+template < typename A >
+void Database< A >::UnmapSequences() {
+  mMappedIdentifiers.Assign( std::vector< char >() );
+  mMappedResidues.Assign( std::vector< char >() );
+  mMappedIdentifierOffsets.Assign( std::vector< size_t >() );
+  mMappedResidueOffsets.Assign( std::vector< size_t >() );
+  mMappedDuplicates.Assign( std::vector< char >() );
+  mMappedDuplicateOffsets.Assign( std::vector< size_t >() );
 }
 
 template < typename A >
@@ -178,38 +1698,165 @@ size_t Database< A >::MaxUniqueKmers() const {
 
 template < typename A >
 size_t Database< A >::KmerLength() const {
-  return mKmerLength;
+  return mSeedMask.Span();
 }
 
 template < typename A >
-bool Database< A >::GetKmersForSequenceId( const SequenceId& seqId,
-                                           const Kmer**      kmers,
-                                           size_t*           numKmers ) const {
-  if( seqId >= NumSequences() )
-    return false;
+template < typename Callback >
+void Database< A >::ForEachIndexedKmer( const Kmer*     kmers,
+                                        const size_t    numKmers,
+                                        const Callback& callback ) const {
+  if( mMinimizerWindow <= 1 ) {
+    for( size_t i = 0; i < numKmers; i++ ) {
+      if( kmers[ i ] != AmbiguousKmer )
+        callback( kmers[ i ], i );
+    }
+    return;
+  }
 
-  const auto& offset = mKmerOffsetBySequenceId[ seqId ];
-  const auto& count  = mKmerCountBySequenceId[ seqId ];
+  Minimizers( kmers, numKmers, mMinimizerWindow ).ForEach( callback );
+}
+
+template < typename A >
+template < typename Callback >
+void Database< A >::ForEachSequenceIdIncludingKmer(
+  const Kmer& kmer, const Callback& callback ) const {
+  if( kmer == AmbiguousKmer )
+    return;
 
-  *kmers    = &mKmers[ offset ];
-  *numKmers = count;
-  return count > 0;
+  ForEachSequenceIdInTables( kmer, callback );
+
+  // Kmers masked in the main tables stay masked in the delta
+  if( mDelta && !IsMaskedKmer( kmer ) ) {
+    const SequenceId firstDeltaId = NumMainSequences();
+    mDelta->ForEachSequenceIdInTables( kmer, [&]( const SequenceId seqId ) {
+      callback( firstDeltaId + seqId );
+    } );
+  }
 }
 
 template < typename A >
-bool Database< A >::GetSequenceIdsIncludingKmer( const Kmer&        kmer,
-                                                 const SequenceId** seqIds,
-                                                 size_t* numSeqIds ) const {
+size_t Database< A >::NumPostingsOfKmer( const Kmer& kmer ) const {
   if( kmer == AmbiguousKmer )
-    return false;
+    return 0;
+
+  size_t begin, end, numPostings = 0;
+  if( PostingsOfKmer( kmer, &begin, &end ) )
+    numPostings += end - begin;
+
+  if( mDelta && !IsMaskedKmer( kmer ) )
+    numPostings += mDelta->NumPostingsOfKmer( kmer );
 
-  if( kmer >= MaxUniqueKmers() )
+  return numPostings;
+}
+
+template < typename A >
+template < typename Callback >
+void Database< A >::ForEachPositionOfKmer( const Kmer&       kmer,
+                                           const SequenceId& seqId,
+                                           const Callback&   callback ) const {
+  if( kmer == AmbiguousKmer )
+    return;
+
+  const SequenceId firstDeltaId = NumMainSequences();
+  if( seqId >= firstDeltaId ) {
+    if( mDelta && !IsMaskedKmer( kmer ) )
+      mDelta->ForEachPositionOfKmer( kmer, seqId - firstDeltaId, callback );
+    return;
+  }
+
+  size_t begin, end;
+  if( !PostingsOfKmer( kmer, &begin, &end ) )
+    return;
+
+  // Postings are sorted by sequence id, then position. A position has to
+  // leave room for the kmer in the sequence.
+  const size_t      length = MainSequenceLength( seqId );
+  const size_t      span   = std::min( mSeedMask.Span(), length );
+  const SequenceId* seqIds = mSequenceIds.data();
+  for( size_t i = std::lower_bound( seqIds + begin, seqIds + end, seqId ) - seqIds;
+       i < end && seqIds[ i ] == seqId; i++ ) {
+    if( mSequencePositions[ i ] + span > length )
+      throw std::runtime_error( "The database index is corrupt" );
+    callback( mSequencePositions[ i ] );
+  }
+}
+
+template < typename A >
+bool Database< A >::PostingsOfKmer( const Kmer& kmer, size_t* begin,
+                                    size_t* end ) const {
+  const size_t slot = SlotForKmer( kmer );
+  if( slot == NoSlot )
     return false;
 
-  const auto& offset = mSequenceIdsOffsetByKmer[ kmer ];
-  const auto& count  = mSequenceIdsCountByKmer[ kmer ];
+  if( mSequenceIdsOffsetByKmer64.empty() ) {
+    *begin = mSequenceIdsOffsetByKmer32[ slot ];
+    *end   = mSequenceIdsOffsetByKmer32[ slot + 1 ];
+  } else {
+    *begin = mSequenceIdsOffsetByKmer64[ slot ];
+    *end   = mSequenceIdsOffsetByKmer64[ slot + 1 ];
+  }
+
+  // Load only checks the first and last offset
+  const size_t numPostings = mCompressSequenceIds
+                               ? mCompressedSequenceIds.size()
+                               : mSequenceIds.size();
+  if( *begin > *end || *end > numPostings )
+    throw std::runtime_error( "The database index is corrupt" );
+  return true;
+}
+
+template < typename A >
+template < typename Callback >
+void Database< A >::ForEachSequenceIdInTables(
+  const Kmer& kmer, const Callback& callback ) const {
+  if( !mPositionalPostings ) {
+    ForEachPostingInTables( kmer, [&]( const SequenceId seqId, const uint32_t ) {
+      callback( seqId );
+    } );
+    return;
+  }
+
+  // Every occurrence is a posting, report each sequence once
+  SequenceId last = NoSequenceId;
+  ForEachPostingInTables( kmer, [&]( const SequenceId seqId, const uint32_t ) {
+    if( seqId == last )
+      return;
 
-  *seqIds    = &mSequenceIds[ offset ];
-  *numSeqIds = count;
-  return count > 0;
+    last = seqId;
+    callback( seqId );
+  } );
+}
+
+template < typename A >
+template < typename Callback >
+void Database< A >::ForEachPostingInTables(
+  const Kmer& kmer, const Callback& callback ) const {
+  size_t begin, end;
+  if( !PostingsOfKmer( kmer, &begin, &end ) )
+    return;
+
+  // Load doesn't walk the postings, they are checked as they are read
+  const size_t numSequences = NumMainSequences();
+  if( !mCompressSequenceIds ) {
+    const SequenceId* seqIds = mSequenceIds.data();
+    for( size_t i = begin; i < end; i++ ) {
+      if( seqIds[ i ] >= numSequences )
+        throw std::runtime_error( "The database index is corrupt" );
+      callback( seqIds[ i ], mPositionalPostings ? mSequencePositions[ i ] : 0 );
+    }
+    return;
+  }
+
+  const uint8_t* data    = mCompressedSequenceIds.data() + begin;
+  const uint8_t* dataEnd = mCompressedSequenceIds.data() + end;
+
+  uint64_t seqId = 0;
+  uint32_t delta;
+  while( data < dataEnd ) {
+    if( !ReadVarint( &data, dataEnd, &delta ) ||
+        ( seqId += delta ) >= numSequences )
+      throw std::runtime_error( "The database index is corrupt" );
+    callback( SequenceId( seqId ), uint32_t( 0 ) );
+  }
 }
@@ -1,14 +1,17 @@
 #pragma once
 
 #include "Search.h"
+#include "Seeds.h"
 
 #include "../Alignment/BandedAlign.h"
 #include "../Alignment/Common.h"
+#include "../Alignment/EditDistance.h"
 #include "../Alignment/ExtendAlign.h"
 #include "../Database.h"
 
-#include <set>
 #include <cstring>
+#include <limits>
+#include <type_traits>
 
 using Counter = unsigned short;
 
@@ -21,65 +24,559 @@ protected:
   using Search< Alphabet >::mDB;
   using Search< Alphabet >::mParams;
 
+  // Whole candidates are bounded by their edit distance before seeding
+  // only for nucleotides and from this minIdentity on. On db_dna it ruled
+  // out over half of the candidates at 0.9 but none at 0.75, where the
+  // Myers pass made searches about 5% slower.
+  static constexpr float MinWholeCandidateBoundIdentity = 0.9f;
+
+  // Batched counting. A batch is a work item of blast.cpp (64 queries),
+  // their counters of a database sequence take a row. Rows are kept under
+  // 16 MB per search (up to 131k sequences with 16-bit counters). Below
+  // 4096 postings for its first query, inst/extdata was slower batched
+  // (13.3 vs 9.4 us/query). At least 4 queries per posting walked keeps
+  // amplicon reads batched and 1.5 kb random queries per query.
+  static constexpr size_t BatchSize                  = 64;
+  static constexpr size_t MaxBatchHitsBytes          = 16 * 1024 * 1024;
+  static constexpr size_t MinBatchFirstQueryPostings = 4096;
+  static constexpr size_t MinBatchQueriesPerPosting  = 4;
+
   void SearchForHits( const Sequence< Alphabet >&              query,
                       const SearchForHitsCallback< Alphabet >& callback );
 
-  std::vector< Counter >  mHits;
-  ExtendAlign< Alphabet > mExtendAlign;
-  BandedAlign< Alphabet > mBandedAlign;
+  void SearchForHits( const SequenceList< Alphabet >&               queries,
+                      const BatchSearchForHitsCallback< Alphabet >& callback );
+
+  void QueryKmers( const Sequence< Alphabet >& query );
+  void IndexedUniqueKmers( std::vector< Kmer >* uniqueKmers );
+  bool CountHits( const SequenceList< Alphabet >& queries, const size_t first,
+                  const size_t last );
+
+  void AlignHSP( const Sequence< Alphabet >& query,
+                 const Sequence< Alphabet >& candidate, const size_t hsp,
+                 size_t* matches, size_t* cols );
+  void AlignChainGap( const Sequence< Alphabet >& query,
+                      const Sequence< Alphabet >& candidate, const size_t gap,
+                      Cigar* cigar, AlignmentCounts* counts );
+  void FindChainGaps( const Sequence< Alphabet >& query,
+                      const Sequence< Alphabet >& candidate );
+  void BoundChainGapEdits( const Sequence< Alphabet >& query,
+                           const Sequence< Alphabet >& candidate );
+  void AlignChainHSPs( const Sequence< Alphabet >& query,
+                       const Sequence< Alphabet >& candidate );
+  bool CanReachMinIdentity( const size_t gap ) const;
+
+  template < typename Callback >
+  void SearchCandidates( const Sequence< Alphabet >& query,
+                         const Highscore& highscore, const Callback& callback );
+
+  // Everything needed per query is kept between queries (every worker
+  // has its own search), so searching doesn't allocate once they've
+  // grown to size
+  std::vector< Counter >    mHits;
+  std::vector< Kmer >       mHitsKmers;
+  Highscore                 mHighscore;
+  Highscore::Entries        mHighscores;
+  // Queries searched together, their counters of a database sequence
+  // are next to each other
+  std::vector< Counter >    mBatchHits;
+  std::vector< std::pair< Kmer, uint32_t > > mBatchKmers;
+  std::vector< Highscore >  mBatchHighscores;
+  std::vector< Kmer >       mKmers;
+  std::vector< Kmer >       mUniqueKmers;
+  std::vector< bool >       mUniqueCheck;
+  Sequence< Alphabet >      mCandidate; // read from a loaded index
+  std::vector< Kmer >       mCandidateKmers;
+  QueryKmerTable            mQueryKmers;
+  Seeds                     mSeeds;
+  std::vector< HSP >        mSegmentPairs;
+  std::vector< HSP >        mHSPs;
+  std::vector< size_t >     mHSPSegmentPairs; // extended into each HSP
+  std::vector< size_t >     mHSPOrder;
+  std::vector< size_t >     mChain;
+  // The gaps before, between and after the HSPs of the chain (query
+  // a1...a2, candidate b1...b2, exclusive), each with the HSP following it
+  struct ChainGap {
+    size_t a1, a2, b1, b2;
+    size_t minEdits; // mismatch and gap columns aligning it takes at least
+    size_t hspMatches, hspCols; // bounded like the gap until counted
+  };
+  std::vector< ChainGap >   mChainGaps;
+  // Of the gaps aligned so far with the HSPs following them, a gap at
+  // either end of the alignment left out
+  AlignmentCounts           mAligned;
+  EditDistance< Alphabet >  mEditDistance;
+  Cigar                     mLeftCigar, mRightCigar;
+  std::vector< Cigar >      mChainGapCigars;
+  Cigar                     mAlignment;
+  ExtendAlign< Alphabet >   mExtendAlign;
+  BandedAlign< Alphabet >   mBandedAlign;
 };
 
 template < typename A >
 GlobalSearch< A >::GlobalSearch( const Database< A >&     db,
                                  const SearchParams< A >& params )
-    : Search< A >( db, params ) {
+    : Search< A >( db, params ), mHighscore( 0 ) {
 
 }
 
 template < typename A >
-void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
-                                  const SearchForHitsCallback< A >& callback ) {
-  const size_t defaultMinHSPLength = 16;
-  const size_t maxHSPJoinDistance  = 16;
+void GlobalSearch< A >::QueryKmers( const Sequence< A >& query ) {
+  mKmers.clear();
+  Kmers< A >( query, mDB.GetSeedMask() )
+    .ForEach( [&]( const Kmer kmer, const size_t ) {
+      mKmers.push_back( kmer );
+    } );
+}
 
-  size_t minHSPLength = std::min( defaultMinHSPLength, query.Length() / 2 );
+// The kmers of the query the way the database indexed them, each once
+// and in ascending order (so every query counts its hits in the same
+// order, on its own or in a batch)
+template < typename A >
+void GlobalSearch< A >::IndexedUniqueKmers( std::vector< Kmer >* uniqueKmers ) {
+  uniqueKmers->clear();
+  if( mDB.HasSparseKmerTable() ) {
+    // Too many possible kmers for a lookup table
+    mDB.ForEachIndexedKmer( mKmers.data(), mKmers.size(), [&]( const Kmer kmer, const size_t ) {
+      uniqueKmers->push_back( kmer );
+    } );
+    std::sort( uniqueKmers->begin(), uniqueKmers->end() );
+    uniqueKmers->erase( std::unique( uniqueKmers->begin(), uniqueKmers->end() ),
+                        uniqueKmers->end() );
+  } else {
+    if( mUniqueCheck.size() < mDB.MaxUniqueKmers() )
+      mUniqueCheck.resize( mDB.MaxUniqueKmers(), false );
+
+    mDB.ForEachIndexedKmer( mKmers.data(), mKmers.size(), [&]( const Kmer kmer, const size_t ) {
+      if( mUniqueCheck[ kmer ] )
+        return;
+
+      mUniqueCheck[ kmer ] = true;
+      uniqueKmers->push_back( kmer );
+    } );
 
+    for( auto kmer : *uniqueKmers )
+      mUniqueCheck[ kmer ] = false;
+    std::sort( uniqueKmers->begin(), uniqueKmers->end() );
+  }
+}
+
+template < typename A >
+void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
+                                  const SearchForHitsCallback< A >& callback ) {
   // Go through each kmer, find hits
   if( mHits.size() < mDB.NumSequences() ) {
     mHits.resize( mDB.NumSequences() );
   }
 
-  // Fast counter reset
-  memset( mHits.data(), 0, sizeof( Counter ) * mHits.capacity() );
+  // Reset the counters of the previous query, by going through the
+  // postings of its kmers again. Unless there are so many of them that
+  // clearing all counters is cheaper.
+  const size_t maxResetHits = mHits.size() / 16;
+  size_t       numResetHits = 0;
+  for( auto kmer : mHitsKmers ) {
+    if( numResetHits > maxResetHits ) {
+      memset( mHits.data(), 0, sizeof( Counter ) * mHits.capacity() );
+      break;
+    }
 
-  Highscore highscore( mParams.maxAccepts + mParams.maxRejects );
+    mDB.ForEachSequenceIdIncludingKmer( kmer, [&]( const SequenceId seqId ) {
+      mHits[ seqId ] = 0;
+      numResetHits++;
+    } );
+  }
+
+  mHighscore.Reset( mParams.maxAccepts + mParams.maxRejects );
+
+  QueryKmers( query );
+  IndexedUniqueKmers( &mHitsKmers );
 
   auto hitsData = mHits.data();
+  for( auto kmer : mHitsKmers ) {
+    mDB.ForEachSequenceIdIncludingKmer( kmer, [&]( const SequenceId seqId ) {
+      Counter counter = ++hitsData[ seqId ];
 
-  std::vector< Kmer > kmers;
-  std::vector< bool > uniqueCheck( mDB.MaxUniqueKmers(), false );
-  Kmers< A >( query, mDB.KmerLength() )
-    .ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      kmers.push_back( kmer );
+      mHighscore.Set( seqId, counter );
+    } );
+  }
 
-      if( kmer == AmbiguousKmer || uniqueCheck[ kmer ] )
-        return;
+  SearchCandidates( query, mHighscore, callback );
+}
 
-      uniqueCheck[ kmer ] = true;
+// Queries are counted BatchSize at a time, going through the postings
+// of each kmer once for all queries of the batch that have it
+template < typename A >
+void GlobalSearch< A >::SearchForHits(
+  const SequenceList< A >& queries, const BatchSearchForHitsCallback< A >& callback ) {
+  const size_t numRows = mDB.NumSequences();
+  if( queries.size() < 2 ||
+      numRows * BatchSize * sizeof( Counter ) > MaxBatchHitsBytes ) {
+    Search< A >::SearchForHits( queries, callback );
+    return;
+  }
 
-      size_t            numSeqIds;
-      const SequenceId* seqIds;
+  if( mBatchHits.size() != numRows * BatchSize ) {
+    mBatchHits.assign( numRows * BatchSize, 0 );
+    mBatchKmers.clear();
+  }
 
-      if( !mDB.GetSequenceIdsIncludingKmer( kmer, &seqIds, &numSeqIds ) )
-        return;
+  if( mBatchHighscores.size() < BatchSize )
+    mBatchHighscores.resize( BatchSize, Highscore( 0 ) );
 
-      for( size_t i = 0; i < numSeqIds; i++ ) {
-        const auto& seqId   = seqIds[ i ];
-        Counter     counter = ++hitsData[ seqId ];
+  for( size_t first = 0; first < queries.size(); first += BatchSize ) {
+    const size_t last = std::min( first + BatchSize, queries.size() );
 
-        highscore.Set( seqId, counter );
+    if( !CountHits( queries, first, last ) ) {
+      for( size_t i = first; i < last; i++ ) {
+        SearchForHits( queries[ i ], [&]( const SequenceId seqId, const Sequence< A >& target,
+                                          const Cigar& alignment ) {
+          callback( i, seqId, target, alignment );
+        } );
       }
+      continue;
+    }
+
+    for( size_t i = first; i < last; i++ ) {
+      QueryKmers( queries[ i ] );
+      SearchCandidates( queries[ i ], mBatchHighscores[ i - first ],
+                        [&]( const SequenceId seqId, const Sequence< A >& target,
+                             const Cigar& alignment ) {
+                          callback( i, seqId, target, alignment );
+                        } );
+    }
+  }
+}
+
+// Counts the hits of queries first to last into the rows of mBatchHits.
+// Nothing is counted (false) if the queries have too few kmers in common
+// to make up for the counters of a sequence being spread over a row, or
+// too few postings.
+template < typename A >
+bool GlobalSearch< A >::CountHits( const SequenceList< A >& queries,
+                                   const size_t first, const size_t last ) {
+  // Short posting lists (small databases) are counted quicker than a
+  // batch is set up, which the first query tells
+  size_t firstCounts = 0;
+  QueryKmers( queries[ first ] );
+  IndexedUniqueKmers( &mUniqueKmers );
+  for( auto kmer : mUniqueKmers )
+    firstCounts += mDB.NumPostingsOfKmer( kmer );
+  if( firstCounts < MinBatchFirstQueryPostings )
+    return false;
+
+  // Reset the rows the previous batch counted in (see above)
+  const size_t maxResetRows = mDB.NumSequences() / 16;
+  size_t       numResetRows = 0;
+  for( size_t i = 0; i < mBatchKmers.size(); i++ ) {
+    if( i > 0 && mBatchKmers[ i ].first == mBatchKmers[ i - 1 ].first )
+      continue;
+
+    if( numResetRows > maxResetRows ) {
+      memset( mBatchHits.data(), 0, sizeof( Counter ) * mBatchHits.size() );
+      break;
+    }
+
+    mDB.ForEachSequenceIdIncludingKmer( mBatchKmers[ i ].first, [&]( const SequenceId seqId ) {
+      memset( &mBatchHits[ seqId * BatchSize ], 0, sizeof( Counter ) * BatchSize );
+      numResetRows++;
     } );
+  }
+
+  // Which queries have a kmer
+  mBatchKmers.clear();
+  for( size_t i = first; i < last; i++ ) {
+    QueryKmers( queries[ i ] );
+    IndexedUniqueKmers( &mUniqueKmers );
+    for( auto kmer : mUniqueKmers )
+      mBatchKmers.emplace_back( kmer, uint32_t( i - first ) );
+
+    mBatchHighscores[ i - first ].Reset( mParams.maxAccepts + mParams.maxRejects );
+  }
+
+  // On average, the queries counting for each posting gone through
+  size_t numPostings = 0, numCounts = 0;
+  if( mDB.HasSparseKmerTable() ) {
+    std::sort( mBatchKmers.begin(), mBatchKmers.end() );
+    for( size_t i = 0; i < mBatchKmers.size(); i++ ) {
+      size_t num = mDB.NumPostingsOfKmer( mBatchKmers[ i ].first );
+      if( i == 0 || mBatchKmers[ i ].first != mBatchKmers[ i - 1 ].first )
+        numPostings += num;
+      numCounts += num;
+    }
+  } else {
+    for( auto& kmerQuery : mBatchKmers ) {
+      size_t num = mDB.NumPostingsOfKmer( kmerQuery.first );
+      if( !mUniqueCheck[ kmerQuery.first ] ) {
+        mUniqueCheck[ kmerQuery.first ] = true;
+        numPostings += num;
+      }
+      numCounts += num;
+    }
+    for( auto& kmerQuery : mBatchKmers )
+      mUniqueCheck[ kmerQuery.first ] = false;
+  }
+
+  if( numCounts < MinBatchQueriesPerPosting * numPostings ) {
+    mBatchKmers.clear();
+    return false;
+  }
+
+  if( !mDB.HasSparseKmerTable() )
+    std::sort( mBatchKmers.begin(), mBatchKmers.end() );
+
+  // The counter of a query has to reach the lowest score it keeps to
+  // change its highscore. Queries without the kmer never reach theirs.
+  const Counter maxCounter = std::numeric_limits< Counter >::max();
+
+  Counter increments[ BatchSize ], limits[ BatchSize ];
+  auto    limitOf = [&]( const size_t q ) {
+    return Counter( std::min< size_t >( mBatchHighscores[ q ].LowestScore(), maxCounter ) );
+  };
+  auto updateHighscore = [&]( const size_t q, const SequenceId seqId,
+                              const Counter counter ) {
+    mBatchHighscores[ q ].Set( seqId, counter );
+    limits[ q ] = limitOf( q );
+  };
+
+  auto hitsData = mBatchHits.data();
+  for( size_t i = 0; i < mBatchKmers.size(); ) {
+    size_t j = i + 1;
+    while( j < mBatchKmers.size() && mBatchKmers[ j ].first == mBatchKmers[ i ].first )
+      j++;
+
+    std::fill( increments, increments + BatchSize, 0 );
+    std::fill( limits, limits + BatchSize, maxCounter );
+    for( size_t k = i; k < j; k++ ) {
+      const uint32_t q = mBatchKmers[ k ].second;
+      increments[ q ]  = 1;
+      limits[ q ]      = limitOf( q );
+    }
+
+    if( ( j - i ) * 4 >= BatchSize ) {
+      // Many queries have the kmer, the whole row is counted at once
+      // (copied so the loops vectorize)
+      mDB.ForEachSequenceIdIncludingKmer( mBatchKmers[ i ].first, [&]( const SequenceId seqId ) {
+        Counter* row = hitsData + seqId * BatchSize;
+        Counter  counters[ BatchSize ];
+        Counter  anyAtLimit = 0;
+
+        memcpy( counters, row, sizeof( counters ) );
+        for( size_t q = 0; q < BatchSize; q++ )
+          counters[ q ] += increments[ q ];
+        for( size_t q = 0; q < BatchSize; q++ )
+          anyAtLimit |= Counter( counters[ q ] >= limits[ q ] );
+        memcpy( row, counters, sizeof( counters ) );
+
+        if( !anyAtLimit )
+          return;
+
+        for( size_t q = 0; q < BatchSize; q++ ) {
+          if( increments[ q ] && counters[ q ] >= limits[ q ] )
+            updateHighscore( q, seqId, counters[ q ] );
+        }
+      } );
+    } else {
+      mDB.ForEachSequenceIdIncludingKmer( mBatchKmers[ i ].first, [&]( const SequenceId seqId ) {
+        Counter* row = hitsData + seqId * BatchSize;
+        for( size_t k = i; k < j; k++ ) {
+          const uint32_t q       = mBatchKmers[ k ].second;
+          Counter        counter = ++row[ q ];
+          if( counter >= limits[ q ] )
+            updateHighscore( q, seqId, counter );
+        }
+      } );
+    }
+
+    i = j;
+  }
+
+  return true;
+}
+
+// HSPs are found by their scores only, the chain's are extended again for
+// their cigars and to count their matches and columns
+template < typename A >
+void GlobalSearch< A >::AlignHSP( const Sequence< A >& query,
+                                  const Sequence< A >& candidate,
+                                  const size_t hsp, size_t* matches,
+                                  size_t* cols ) {
+  const HSP&      sp = mSegmentPairs[ mHSPSegmentPairs[ hsp ] ];
+  AlignmentCounts left, right;
+
+  mExtendAlign.Extend( query, candidate, NULL, NULL, &mLeftCigar,
+                       AlignmentDirection::Reverse, sp.a1, sp.b1, &left );
+  mExtendAlign.Extend( query, candidate, NULL, NULL, &mRightCigar,
+                       AlignmentDirection::Forward, sp.a2 + 1, sp.b2 + 1,
+                       &right );
+
+  // Spaced seeds, so the segment pair can't be assumed to fully match
+  Cigar& cigar = mHSPs[ hsp ].cigar;
+  cigar.Clear();
+  cigar += mLeftCigar;
+  *matches = left.matches + right.matches;
+  *cols    = left.cols + right.cols;
+  for( size_t a = sp.a1, b = sp.b1; a <= sp.a2 && b <= sp.b2; a++, b++ ) {
+    bool match = MatchPolicy< A >::Match( query[ a ], candidate[ b ] );
+    cigar.Add( match ? CigarOp::Match : CigarOp::Mismatch );
+    *matches += match;
+    ( *cols )++;
+  }
+  cigar += mRightCigar;
+}
+
+template < typename A >
+void GlobalSearch< A >::FindChainGaps( const Sequence< A >& query,
+                                       const Sequence< A >& candidate ) {
+  mChainGaps.resize( mChain.size() + 1 );
+  for( size_t i = 0; i <= mChain.size(); i++ ) {
+    ChainGap& gap = mChainGaps[ i ];
+    gap.a1 = i > 0 ? mHSPs[ mChain[ i - 1 ] ].a2 + 1 : 0;
+    gap.b1 = i > 0 ? mHSPs[ mChain[ i - 1 ] ].b2 + 1 : 0;
+    gap.a2 = i < mChain.size() ? mHSPs[ mChain[ i ] ].a1 : query.Length();
+    gap.b2 = i < mChain.size() ? mHSPs[ mChain[ i ] ].b1 : candidate.Length();
+    gap.a2 = std::max( gap.a1, gap.a2 );
+    gap.b2 = std::max( gap.b1, gap.b2 );
+
+    // The longer side of a gap adds columns, unless it can be left as a
+    // terminal gap
+    size_t lenA  = gap.a2 - gap.a1, lenB = gap.b2 - gap.b1;
+    gap.minEdits = i == 0 || i == mChain.size()
+                     ? 0
+                     : std::max( lenA, lenB ) - std::min( lenA, lenB );
+
+    // At best the shorter side of an HSP matches as well
+    gap.hspMatches = gap.hspCols = 0;
+    if( i < mChain.size() ) {
+      const HSP& hsp     = mHSPs[ mChain[ i ] ];
+      size_t     hspLenA = hsp.a2 - hsp.a1 + 1, hspLenB = hsp.b2 - hsp.b1 + 1;
+      gap.hspMatches     = std::min( hspLenA, hspLenB );
+      gap.hspCols        = std::max( hspLenA, hspLenB );
+    }
+  }
+}
+
+// Aligns the given gap of the chain (see FindChainGaps) for its cigar and
+// (or) counts its matches and columns
+template < typename A >
+void GlobalSearch< A >::AlignChainGap( const Sequence< A >& query,
+                                       const Sequence< A >& candidate,
+                                       const size_t gap, Cigar* cigar,
+                                       AlignmentCounts* counts ) {
+  if( gap == 0 ) {
+    // Align first HSP's start to whole sequences begin
+    auto& first = mHSPs[ mChain.front() ];
+    mBandedAlign.Align( query, candidate, cigar, AlignmentDirection::Reverse,
+                        first.a1, first.b1, -1, -1, counts );
+  } else if( gap < mChain.size() ) {
+    // Align in between the HSP's
+    auto& current = mHSPs[ mChain[ gap - 1 ] ];
+    auto& next    = mHSPs[ mChain[ gap ] ];
+    mBandedAlign.Align( query, candidate, cigar, AlignmentDirection::Forward,
+                        current.a2 + 1, current.b2 + 1, next.a1, next.b1,
+                        counts );
+  } else {
+    // Align last HSP's end to whole sequences end
+    auto& last = mHSPs[ mChain.back() ];
+    mBandedAlign.Align( query, candidate, cigar, AlignmentDirection::Forward,
+                        last.a2 + 1, last.b2 + 1, -1, -1, counts );
+  }
+}
+
+// The edit distances of the gaps and HSPs (bit-parallel, so a lot cheaper
+// than aligning or extending them) bound the columns they add tighter. Only
+// worth it when the candidate would be ruled out if the gaps were far apart
+// enough.
+template < typename A >
+void GlobalSearch< A >::BoundChainGapEdits( const Sequence< A >& query,
+                                            const Sequence< A >& candidate ) {
+  using FreeGaps = typename EditDistance< A >::FreeGaps;
+
+  size_t matches = 0, cols = 0;
+  for( size_t i = 0; i < mChainGaps.size(); i++ ) {
+    const ChainGap& gap  = mChainGaps[ i ];
+    size_t          lenA = gap.a2 - gap.a1, lenB = gap.b2 - gap.b1;
+    matches += std::min( lenA, lenB ) + gap.hspMatches;
+    cols += ( i == 0 || i + 1 == mChainGaps.size() ? std::min( lenA, lenB )
+                                                  : std::max( lenA, lenB ) ) +
+            std::min( lenA, lenB ) + gap.hspCols;
+  }
+  if( cols == 0 || float( matches ) / float( cols ) >= mParams.minIdentity )
+    return;
+
+  for( size_t i = 0; i < mChainGaps.size(); i++ ) {
+    ChainGap& gap  = mChainGaps[ i ];
+    FreeGaps  free = i == 0                      ? FreeGaps::Leading
+                     : i + 1 == mChainGaps.size() ? FreeGaps::Trailing
+                                                 : FreeGaps::None;
+    gap.minEdits   = mEditDistance.Compute( query, gap.a1, gap.a2, candidate,
+                                            gap.b1, gap.b2, free );
+    if( !CanReachMinIdentity( 0 ) )
+      return;
+
+    if( i < mChain.size() ) {
+      const HSP& hsp = mHSPs[ mChain[ i ] ];
+      gap.hspCols    = gap.hspMatches +
+                    mEditDistance.Compute( query, hsp.a1, hsp.a2 + 1, candidate,
+                                           hsp.b1, hsp.b2 + 1 );
+      if( !CanReachMinIdentity( 0 ) )
+        return;
+    }
+  }
+}
+
+// The HSPs are only aligned once the bounds don't rule the candidate out.
+// An HSP never starts or ends in a gap, all its columns count.
+template < typename A >
+void GlobalSearch< A >::AlignChainHSPs( const Sequence< A >& query,
+                                        const Sequence< A >& candidate ) {
+  for( size_t i = 0; i < mChain.size(); i++ ) {
+    ChainGap& gap = mChainGaps[ i ];
+    AlignHSP( query, candidate, mChain[ i ], &gap.hspMatches, &gap.hspCols );
+    if( !CanReachMinIdentity( 0 ) )
+      return;
+  }
+}
+
+// Highest identity the alignment of the chain (mAligned) can reach,
+// being done up to the given gap (0 is the one before the first HSP,
+// mChain.size() the one after the last). At best, the shorter side of
+// each gap left matches. A gap at either end of the alignment doesn't
+// count.
+template < typename A >
+bool GlobalSearch< A >::CanReachMinIdentity( const size_t gap ) const {
+  size_t matches = mAligned.matches, cols = mAligned.cols;
+
+  for( size_t i = gap; i < mChainGaps.size(); i++ ) {
+    const ChainGap& chainGap = mChainGaps[ i ];
+    size_t          shorter  = std::min( chainGap.a2 - chainGap.a1,
+                                         chainGap.b2 - chainGap.b1 );
+    matches += shorter + chainGap.hspMatches;
+    cols += shorter + chainGap.minEdits + chainGap.hspCols;
+  }
+
+  return cols == 0 || float( matches ) / float( cols ) >= mParams.minIdentity;
+}
+
+template < typename A >
+template < typename Callback >
+void GlobalSearch< A >::SearchCandidates( const Sequence< A >& query,
+                                          const Highscore&     highscore,
+                                          const Callback&      callback ) {
+  const size_t defaultMinHSPLength = 16;
+  const size_t maxHSPJoinDistance  = 16;
+
+  size_t minHSPLength = std::min( defaultMinHSPLength, query.Length() / 2 );
+
+  const bool boundWholeCandidates =
+    std::is_same< A, DNA >::value &&
+    mParams.minIdentity >= MinWholeCandidateBoundIdentity;
+
+  auto& kmers = mKmers;
+
+  // Without positional postings the kmers of each candidate are joined
+  // with those of the query
+  if( !mDB.HasPositionalPostings() )
+    mQueryKmers.Assign( kmers.data(), kmers.size() );
 
   // For each candidate:
   // - Get HSPs,
@@ -90,159 +587,197 @@ void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
   int numHits    = 0;
   int numRejects = 0;
 
-  auto highscores = highscore.EntriesFromTopToBottom();
-
-  HitList< A > hits;
+  highscore.EntriesFromTopToBottom( &mHighscores );
 
-  for( auto it = highscores.cbegin(); it != highscores.cend(); ++it ) {
+  for( auto it = mHighscores.cbegin(); it != mHighscores.cend(); ++it ) {
     const size_t         seqId        = it->id;
-    const Sequence< A >& candidateSeq = mDB.GetSequenceById( seqId );
+    const Sequence< A >& candidateSeq =
+      mDB.GetSequenceById( seqId, &mCandidate );
 
-    std::deque< HSP > sps;
-
-    for( size_t pos = 0; pos < kmers.size(); pos++ ) {
-      const Kmer* kmers2;
-      size_t      kmers2count;
-      if( !mDB.GetKmersForSequenceId( seqId, &kmers2, &kmers2count ) )
-        continue;
+    // Whole sequences too far apart are rejected before any seeding
+    if( boundWholeCandidates &&
+        mEditDistance.MaxIdentity( query, candidateSeq ) <
+          mParams.minIdentity ) {
+      numRejects++;
+      if( numRejects >= mParams.maxRejects )
+        break;
+      continue;
+    }
 
-      for( size_t pos2 = 0; pos2 < kmers2count; pos2++ ) {
-        if( kmers2[ pos2 ] != kmers[ pos ] )
-          continue;
-
-        // Look for the start of a "diagonal" (alignment matrix), then follow it
-        if( pos == 0 || pos2 == 0 || kmers[ pos - 1 ] == AmbiguousKmer ||
-            kmers2[ pos2 - 1 ] == AmbiguousKmer ||
-            ( kmers[ pos - 1 ] != kmers2[ pos2 - 1 ] ) ) {
-          size_t length = mDB.KmerLength();
-
-          size_t cur  = pos + 1;
-          size_t cur2 = pos2 + 1;
-          while( cur < kmers.size() && cur2 < kmers2count &&
-                 kmers[ cur ] != AmbiguousKmer &&
-                 kmers2[ cur ] != AmbiguousKmer &&
-                 kmers[ cur ] == kmers2[ cur2 ] ) {
-            cur++;
-            cur2++;
-            length++;
-          }
-
-          sps.emplace_back( pos, cur - 1, pos2, cur2 - 1 );
-        }
+    // Seeds are kmers shared on a diagonal, chained into segment pairs.
+    // Positional postings tell where the kmers are in the candidate,
+    // which otherwise has its kmers regenerated and looked up in the
+    // query's table.
+    mSeeds.Clear();
+    size_t maxSeedGap = 1;
+
+    if( mDB.HasPositionalPostings() ) {
+      maxSeedGap = std::max< size_t >( 1, mDB.GetMinimizerWindow() );
+      for( size_t pos = 0; pos < kmers.size(); pos++ ) {
+        mDB.ForEachPositionOfKmer( kmers[ pos ], seqId,
+          [&]( const size_t pos2 ) { mSeeds.Add( pos, pos2 ); } );
       }
-    };
+    } else {
+      mCandidateKmers.clear();
+      Kmers< A >( candidateSeq, mDB.GetSeedMask() )
+        .ForEach( [&]( const Kmer kmer, const size_t ) {
+          mCandidateKmers.push_back( kmer );
+        } );
+      mSeeds.AddMatches( mQueryKmers, mCandidateKmers.data(),
+                         mCandidateKmers.size() );
+    }
+
+    mSeeds.ToSegmentPairs( maxSeedGap, &mSegmentPairs );
 
     // Find all HSP
     // Sort by length
     // Try to find best chain
     // Fill space between with banded align
-    std::set< HSP > hsps;
-    for( auto& sp : sps ) {
-      size_t queryPos, candidatePos;
+    //
+    // The HSPs (and their cigars) are kept across candidates, only the
+    // first numHSPs are in use. Only an accepted chain's get their cigars.
+    size_t numHSPs = 0;
+    mHSPSegmentPairs.clear();
+    for( size_t i = 0; i < mSegmentPairs.size(); i++ ) {
+      const HSP& sp = mSegmentPairs[ i ];
+      size_t     queryPos, candidatePos;
 
       size_t a1 = sp.a1, a2 = sp.a2, b1 = sp.b1, b2 = sp.b2;
 
-      Cigar leftCigar;
-      int   leftScore =
+      // Scores only, the cigar is left to AlignHSP
+      int leftScore =
         mExtendAlign.Extend( query, candidateSeq, &queryPos, &candidatePos,
-                             &leftCigar, AlignmentDirection::Reverse, a1, b1 );
-      if( !leftCigar.empty() ) {
+                             NULL, AlignmentDirection::Reverse, a1, b1 );
+      if( leftScore > 0 ) {
         a1 = queryPos;
         b1 = candidatePos;
       }
 
-      Cigar  rightCigar;
-      size_t rightQuery, rightCandidate;
-      int    rightScore = mExtendAlign.Extend(
-        query, candidateSeq, &queryPos, &candidatePos, &rightCigar,
+      int rightScore = mExtendAlign.Extend(
+        query, candidateSeq, &queryPos, &candidatePos, NULL,
         AlignmentDirection::Forward, a2 + 1, b2 + 1 );
-      if( !rightCigar.empty() ) {
+      if( rightScore > 0 ) {
         a2 = queryPos;
         b2 = candidatePos;
       }
 
-      HSP hsp( a1, a2, b1, b2 );
-      if( hsp.Length() >= minHSPLength ) {
-        // Construct hsp cigar (spaced seeds so we cannot assume full match)
-        Cigar middleCigar;
-        int   middleScore = 0;
-        for( size_t a = sp.a1, b = sp.b1; a <= sp.a2 && b <= sp.b2; a++, b++ ) {
-          auto   chA = query[ a ], chB = candidateSeq[ b ];
-          bool   match = MatchPolicy< A >::Match( chA, chB );
-          int8_t score = ScorePolicy< A >::Score( chA, chB );
-          middleCigar.Add( match ? CigarOp::Match : CigarOp::Mismatch );
-          middleScore += score;
-        }
-        hsp.score = leftScore + middleScore + rightScore;
-        hsp.cigar = leftCigar + middleCigar + rightCigar;
+      if( HSP( a1, a2, b1, b2 ).Length() >= minHSPLength ) {
+        int middleScore = 0;
+        for( size_t a = sp.a1, b = sp.b1; a <= sp.a2 && b <= sp.b2; a++, b++ )
+          middleScore += ScorePolicy< A >::Score( query[ a ], candidateSeq[ b ] );
 
         // Save HSP
-        hsps.insert( hsp );
+        if( numHSPs == mHSPs.size() )
+          mHSPs.emplace_back( a1, a2, b1, b2 );
+
+        HSP& hsp  = mHSPs[ numHSPs++ ];
+        hsp.a1    = a1;
+        hsp.a2    = a2;
+        hsp.b1    = b1;
+        hsp.b2    = b2;
+        hsp.score = leftScore + middleScore + rightScore;
+        mHSPSegmentPairs.push_back( i );
       }
     }
 
-    // Greedy join HSPs if close
-    struct HSPChainOrdering {
-      bool operator()( const HSP& left, const HSP& right ) const {
-        return left.a1 < right.a1 && left.b1 < right.b1;
-      }
-    };
+    // Highest scores first, of HSPs scoring the same only the first
+    // found is considered
+    mHSPOrder.clear();
+    for( size_t i = 0; i < numHSPs; i++ )
+      mHSPOrder.push_back( i );
+    std::sort( mHSPOrder.begin(), mHSPOrder.end(),
+               [&]( const size_t left, const size_t right ) {
+                 return mHSPs[ left ].score > mHSPs[ right ].score ||
+                        ( mHSPs[ left ].score == mHSPs[ right ].score &&
+                          left < right );
+               } );
+
+    // Greedy join HSPs if close. The chain is ordered along both
+    // sequences, HSPs crossing one of it are left out.
+    mChain.clear();
+    for( size_t i = 0; i < mHSPOrder.size(); i++ ) {
+      if( i > 0 &&
+          mHSPs[ mHSPOrder[ i ] ].score == mHSPs[ mHSPOrder[ i - 1 ] ].score )
+        continue;
 
-    std::set< HSP, HSPChainOrdering > chain;
-    for( auto it = hsps.rbegin(); it != hsps.rend(); ++it ) {
-      const HSP& hsp = *it;
+      const HSP& hsp = mHSPs[ mHSPOrder[ i ] ];
       bool       hasNoOverlaps =
-        std::none_of( chain.begin(), chain.end(), [&]( const HSP& existing ) {
-          return hsp.IsOverlapping( existing );
+        std::none_of( mChain.begin(), mChain.end(), [&]( const size_t existing ) {
+          return hsp.IsOverlapping( mHSPs[ existing ] );
         } );
-      if( hasNoOverlaps ) {
-        bool anyHSPJoinable =
-          std::any_of( chain.begin(), chain.end(), [&]( const HSP& existing ) {
-            return hsp.DistanceTo( existing ) <= maxHSPJoinDistance;
-          } );
-
-        if( chain.empty() || anyHSPJoinable ) {
-          chain.insert( hsp );
-        }
-      }
+      if( !hasNoOverlaps )
+        continue;
+
+      bool anyHSPJoinable =
+        std::any_of( mChain.begin(), mChain.end(), [&]( const size_t existing ) {
+          return hsp.DistanceTo( mHSPs[ existing ] ) <= maxHSPJoinDistance;
+        } );
+      if( !mChain.empty() && !anyHSPJoinable )
+        continue;
+
+      auto pos = std::find_if( mChain.begin(), mChain.end(),
+                               [&]( const size_t existing ) {
+                                 return hsp.a1 < mHSPs[ existing ].a1;
+                               } );
+      bool isCrossing =
+        std::any_of( mChain.begin(), pos, [&]( const size_t existing ) {
+          return mHSPs[ existing ].b1 > hsp.b1;
+        } ) ||
+        std::any_of( pos, mChain.end(), [&]( const size_t existing ) {
+          return mHSPs[ existing ].b1 < hsp.b1;
+        } );
+      if( !isCrossing )
+        mChain.insert( pos, mHSPOrder[ i ] );
     }
 
     bool accept = false;
-    if( chain.size() > 0 ) {
-      Cigar alignment;
-      Cigar cigar;
-
-      // Align first HSP's start to whole sequences begin
-      auto& first = *chain.cbegin();
-      mBandedAlign.Align( query, candidateSeq, &cigar,
-                          AlignmentDirection::Reverse, first.a1, first.b1 );
-      alignment += cigar;
-
-      // Align in between the HSP's
-      for( auto it1 = chain.cbegin(), it2 = ++chain.cbegin();
-           it1 != chain.cend() && it2 != chain.cend(); ++it1, ++it2 ) {
-        auto& current = *it1;
-        auto& next    = *it2;
-
-        alignment += current.cigar;
-        mBandedAlign.Align( query, candidateSeq, &cigar,
-                            AlignmentDirection::Forward, current.a2 + 1,
-                            current.b2 + 1, next.a1, next.b1 );
-        alignment += cigar;
-      }
+    if( mChain.size() > 0 ) {
+      // The gaps before, between and after the HSPs are aligned in turn,
+      // their matches and columns counted along. The candidate is given up
+      // on as soon as it can't reach the minimum identity anymore, however
+      // well the rest aligns. The cigars of an accepted one are kept.
+      mAligned = AlignmentCounts();
+      FindChainGaps( query, candidateSeq );
+      if( CanReachMinIdentity( 0 ) )
+        BoundChainGapEdits( query, candidateSeq );
+      if( CanReachMinIdentity( 0 ) )
+        AlignChainHSPs( query, candidateSeq );
+
+      if( mChainGapCigars.size() < mChainGaps.size() )
+        mChainGapCigars.resize( mChainGaps.size() );
+
+      bool abandoned = false;
+      for( size_t gap = 0; gap <= mChain.size(); gap++ ) {
+        if( !CanReachMinIdentity( gap ) ) {
+          abandoned = true;
+          break;
+        }
 
-      // Align last HSP's end to whole sequences end
-      auto& last = *chain.crbegin();
-      alignment += last.cigar;
-      mBandedAlign.Align( query, candidateSeq, &cigar,
-                          AlignmentDirection::Forward, last.a2 + 1,
-                          last.b2 + 1 );
-      alignment += cigar;
+        AlignmentCounts counts;
+        AlignChainGap( query, candidateSeq, gap, &mChainGapCigars[ gap ],
+                       &counts );
+        if( gap == 0 || gap == mChain.size() )
+          counts.cols -= counts.endGap;
 
-      float identity = alignment.Identity();
-      if( identity >= mParams.minIdentity ) {
+        mAligned.matches += counts.matches + mChainGaps[ gap ].hspMatches;
+        mAligned.cols += counts.cols + mChainGaps[ gap ].hspCols;
+      }
+
+      // As Cigar::Identity tells it
+      float identity = mAligned.cols > 0 ? float( mAligned.matches ) /
+                                             float( mAligned.cols )
+                                         : 0.0f;
+      if( !abandoned && identity >= mParams.minIdentity ) {
         accept = true;
-        callback( candidateSeq, alignment );
+
+        auto& alignment = mAlignment;
+        alignment.Clear();
+        for( size_t gap = 0; gap <= mChain.size(); gap++ ) {
+          alignment += mChainGapCigars[ gap ];
+          if( gap < mChain.size() )
+            alignment += mHSPs[ mChain[ gap ] ].cigar;
+        }
+        callback( seqId, candidateSeq, alignment );
       }
     }
 
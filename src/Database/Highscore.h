@@ -2,8 +2,15 @@
 
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <cstdint>
 
+// The ids with the highest scores. A min heap (lowest score on top)
+// plus a hash table from id to heap node, so an update takes O(log n).
+// Each id keeps the position it had in the flat array this replaced,
+// so ties are kept, dropped and listed in the same order as before.
 class Highscore {
+public:
   class Entry {
   public:
     size_t id    = 0;
@@ -13,10 +20,28 @@ class Highscore {
       return score < other.score;
     }
   };
+  using Entries = std::vector< Entry >;
 
-public:
-  Highscore( const size_t numHighestEntriesToKeep ) : mLowestScore( 0 ) {
-    mEntries.resize( numHighestEntriesToKeep );
+  Highscore( const size_t numHighestEntriesToKeep ) {
+    Reset( numHighestEntriesToKeep );
+  }
+
+  void Reset( const size_t numHighestEntriesToKeep ) {
+    mLowestScore = 0;
+    mMaxEntries  = numHighestEntriesToKeep;
+
+    size_t slotBits = 1;
+    while( ( size_t( 1 ) << slotBits ) < 2 * numHighestEntriesToKeep )
+      slotBits++;
+
+    if( slotBits != mSlotBits || mSlots.empty() ) {
+      mSlotBits = slotBits;
+      mSlots.assign( size_t( 1 ) << slotBits, Slot() );
+    } else {
+      for( auto& node : mNodes )
+        mSlots[ node.slot ] = Slot();
+    }
+    mNodes.clear();
   }
 
   // score is assumed to increase for every id
@@ -24,27 +49,20 @@ public:
     if( score < mLowestScore )
       return;
 
-    auto it = std::find_if(
-      mEntries.begin(), mEntries.end(),
-      [id]( const Entry& candidate ) { return id == candidate.id; } );
-
-    if( it == mEntries.end() ) {
-      it = std::find_if(
-        mEntries.begin(), mEntries.end(),
-        [score]( const Entry& candidate ) { return score > candidate.score; } );
-    }
-
-    if( it != mEntries.end() ) {
-      it->id    = id;
-      it->score = score;
+    Update( id, score );
+  }
 
-      mLowestScore =
-        std::min_element( mEntries.begin(), mEntries.end() )->score;
-    }
+  size_t LowestScore() const {
+    return mLowestScore;
   }
 
-  std::vector< Entry > EntriesFromTopToBottom() const {
-    std::vector< Entry > sorted = mEntries;
+  void EntriesFromTopToBottom( Entries* entries ) const {
+    Entries& sorted = *entries;
+    sorted.resize( mNodes.size() );
+    for( auto& node : mNodes ) {
+      sorted[ node.pos ].id    = node.id;
+      sorted[ node.pos ].score = node.score;
+    }
 
     // remove empty elements
     sorted.erase(
@@ -58,10 +76,127 @@ public:
 
     // reverse
     std::reverse( sorted.begin(), sorted.end() );
-    return sorted;
   }
 
 private:
-  size_t               mLowestScore;
-  std::vector< Entry > mEntries;
+  static const size_t NoNode = std::numeric_limits< size_t >::max();
+
+  struct Node {
+    size_t id;
+    size_t score;
+    size_t slot;
+    size_t pos;
+  };
+
+  struct Slot {
+    size_t id   = 0;
+    size_t node = NoNode;
+  };
+
+  void Update( const size_t id, const size_t score ) {
+    if( mMaxEntries == 0 )
+      return;
+
+    size_t slot = FindSlot( id );
+    if( mSlots[ slot ].node != NoNode ) {
+      // Score of a kept id went up
+      size_t node = mSlots[ slot ].node;
+      mNodes[ node ].score = score;
+      SiftDown( node );
+    } else if( mNodes.size() < mMaxEntries ) {
+      mSlots[ slot ].id   = id;
+      mSlots[ slot ].node = mNodes.size();
+      mNodes.push_back( { id, score, slot, mNodes.size() } );
+      SiftUp( mNodes.size() - 1 );
+    } else if( score > mNodes[ 0 ].score ) {
+      // Replaces the lowest one, in its position
+      RemoveSlot( mNodes[ 0 ].slot );
+      slot                = FindSlot( id );
+      mSlots[ slot ].id   = id;
+      mSlots[ slot ].node = 0;
+      mNodes[ 0 ]         = { id, score, slot, mNodes[ 0 ].pos };
+      SiftDown( 0 );
+    } else {
+      return;
+    }
+
+    if( mNodes.size() == mMaxEntries )
+      mLowestScore = mNodes[ 0 ].score;
+  }
+
+  size_t FindSlot( const size_t id ) const {
+    const size_t mask = mSlots.size() - 1;
+
+    size_t slot = HashSlot( id );
+    while( mSlots[ slot ].node != NoNode && mSlots[ slot ].id != id )
+      slot = ( slot + 1 ) & mask;
+
+    return slot;
+  }
+
+  // Backward shift deletion, so no probe sequence is cut short
+  void RemoveSlot( size_t slot ) {
+    const size_t mask = mSlots.size() - 1;
+
+    for( size_t next = ( slot + 1 ) & mask; mSlots[ next ].node != NoNode;
+         next        = ( next + 1 ) & mask ) {
+      size_t home = HashSlot( mSlots[ next ].id );
+      if( ( ( next - home ) & mask ) >= ( ( next - slot ) & mask ) ) {
+        mSlots[ slot ]                     = mSlots[ next ];
+        mNodes[ mSlots[ slot ].node ].slot = slot;
+        slot                               = next;
+      }
+    }
+    mSlots[ slot ] = Slot();
+  }
+
+  size_t HashSlot( const size_t id ) const {
+    return ( uint64_t( id ) * 0x9E3779B97F4A7C15ULL ) >> ( 64 - mSlotBits );
+  }
+
+  void SiftUp( size_t node ) {
+    while( node > 0 ) {
+      size_t parent = ( node - 1 ) / 2;
+      if( !IsLower( mNodes[ node ], mNodes[ parent ] ) )
+        break;
+
+      Swap( node, parent );
+      node = parent;
+    }
+  }
+
+  void SiftDown( size_t node ) {
+    while( true ) {
+      size_t lowest = node;
+      size_t left   = 2 * node + 1;
+      size_t right  = left + 1;
+
+      if( left < mNodes.size() && IsLower( mNodes[ left ], mNodes[ lowest ] ) )
+        lowest = left;
+      if( right < mNodes.size() && IsLower( mNodes[ right ], mNodes[ lowest ] ) )
+        lowest = right;
+      if( lowest == node )
+        break;
+
+      Swap( node, lowest );
+      node = lowest;
+    }
+  }
+
+  // Of equal scores, the first position goes first
+  static bool IsLower( const Node& a, const Node& b ) {
+    return a.score < b.score || ( a.score == b.score && a.pos < b.pos );
+  }
+
+  void Swap( const size_t a, const size_t b ) {
+    std::swap( mNodes[ a ], mNodes[ b ] );
+    mSlots[ mNodes[ a ].slot ].node = a;
+    mSlots[ mNodes[ b ].slot ].node = b;
+  }
+
+  size_t              mLowestScore;
+  size_t              mMaxEntries;
+  size_t              mSlotBits = 0;
+  std::vector< Node > mNodes;
+  std::vector< Slot > mSlots;
 };
@@ -4,20 +4,82 @@
 #include "../Utils.h"
 
 #include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-using Kmer = uint32_t;
+using Kmer = uint64_t;
 const Kmer AmbiguousKmer = ( Kmer )-1;
 
+// Seed pattern, positions marked '1' have to match while '0' positions
+// are ignored, e.g. 1101101101. A contiguous seed of length k is k ones.
+class SeedMask {
+public:
+  SeedMask( const size_t length ) : mPattern( length, '1' ) {
+    Update();
+  }
+
+  SeedMask( const std::string& pattern ) : mPattern( pattern ) {
+    if( mPattern.empty() ||
+        mPattern.find_first_not_of( "01" ) != std::string::npos )
+      throw std::runtime_error( "Seed mask must consist of 0s and 1s" );
+    if( mPattern.front() != '1' || mPattern.back() != '1' )
+      throw std::runtime_error( "Seed mask must start and end with 1" );
+    Update();
+  }
+
+  const std::string& Pattern() const {
+    return mPattern;
+  }
+
+  // Number of residues covered
+  size_t Span() const {
+    return mPattern.size();
+  }
+
+  // Number of residues which have to match
+  size_t Weight() const {
+    return mOffsets.size();
+  }
+
+  bool IsContiguous() const {
+    return Weight() == Span();
+  }
+
+  // Positions of the '1's
+  const std::vector< size_t >& Offsets() const {
+    return mOffsets;
+  }
+
+private:
+  void Update() {
+    mOffsets.clear();
+    for( size_t i = 0; i < mPattern.size(); i++ ) {
+      if( mPattern[ i ] == '1' )
+        mOffsets.push_back( i );
+    }
+  }
+
+  std::string           mPattern;
+  std::vector< size_t > mOffsets;
+};
+
 template< typename Alphabet >
 class Kmers {
 public:
   using Callback = const std::function< void( const Kmer, const size_t ) >;
 
-  Kmers( const Sequence< Alphabet >& ref, const size_t length ) : mRef( ref ) {
-    mLength = std::min( { length, mRef.Length(), sizeof( Kmer ) * 8 / BitMapPolicy< Alphabet >::NumBits } );
+  Kmers( const Sequence< Alphabet >& ref, const SeedMask& mask )
+      : mRef( ref ), mMask( mask ) {
+    mLength = std::min( { mask.Span(), mRef.Length(), sizeof( Kmer ) * 8 / BitMapPolicy< Alphabet >::NumBits } );
   }
 
   void ForEach( const Callback& block ) const {
+    if( !mMask.IsContiguous() ) {
+      ForEachSpaced( block );
+      return;
+    }
+
     const char* ptr = mRef.sequence.data();
 
     auto bitIndex = []( const size_t pos ) {
@@ -36,7 +98,7 @@ public:
       if( val < 0 ) {
         lastAmbigIndex = k;
       } else {
-        kmer |= ( val << bitIndex( k ) );
+        kmer |= ( ( Kmer ) val << bitIndex( k ) );
       }
       ptr++;
     }
@@ -55,7 +117,7 @@ public:
       if( val < 0 ) {
         lastAmbigIndex = frame + mLength - 1;
       } else {
-        kmer |= ( val << bitIndex( mLength - 1 ) );
+        kmer |= ( ( Kmer ) val << bitIndex( mLength - 1 ) );
       }
 
       if( lastAmbigIndex == ( size_t ) -1 || frame > lastAmbigIndex ) {
@@ -67,10 +129,39 @@ public:
   }
 
   size_t Count() const {
+    if( !mMask.IsContiguous() )
+      return mRef.Length() >= mMask.Span() ? mRef.Length() - mMask.Span() + 1 : 0;
+
     return mRef.Length() - mLength + 1;
   }
 
 private:
+  // Only the '1' positions of the mask make up the kmer, ambiguous
+  // residues at '0' positions don't matter
+  void ForEachSpaced( const Callback& block ) const {
+    if( mRef.Length() < mMask.Span() )
+      return;
+
+    const char* ptr     = mRef.sequence.data();
+    const auto& offsets = mMask.Offsets();
+
+    size_t maxFrame = mRef.Length() - mMask.Span();
+    for( size_t frame = 0; frame <= maxFrame; frame++, ptr++ ) {
+      Kmer kmer = 0;
+      for( size_t i = 0; i < offsets.size(); i++ ) {
+        int8_t val = BitMapPolicy< Alphabet >::BitMap( ptr[ offsets[ i ] ] );
+        if( val < 0 ) {
+          kmer = AmbiguousKmer;
+          break;
+        }
+        kmer |= ( ( Kmer ) val << ( i * BitMapPolicy< Alphabet >::NumBits ) );
+      }
+
+      block( kmer, frame );
+    }
+  }
+
   size_t                      mLength;
   const Sequence< Alphabet >& mRef;
+  const SeedMask&             mMask;
 };
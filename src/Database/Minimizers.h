@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Kmers.h"
+
+#include <deque>
+#include <utility>
+
+// (w,k)-minimizers: of every window of w consecutive kmers only the
+// smallest (by hash) is kept. Two sequences sharing at least w + k - 1
+// residues are thus guaranteed to share a minimizer.
+class Minimizers {
+public:
+  Minimizers( const Kmer* kmers, const size_t numKmers, const size_t window )
+      : mKmers( kmers ), mNumKmers( numKmers ), mWindow( window ) {}
+
+  // Ambiguous kmers are never picked, windows made up of them only
+  // yield nothing
+  template < typename Callback >
+  void ForEach( const Callback& block ) const {
+    // Candidates by position, their hashes ascending
+    std::deque< std::pair< uint64_t, size_t > > candidates;
+    size_t lastPos = ( size_t )-1;
+
+    for( size_t pos = 0; pos < mNumKmers; pos++ ) {
+      if( mKmers[ pos ] != AmbiguousKmer ) {
+        uint64_t hash = Hash( mKmers[ pos ] );
+        while( !candidates.empty() && candidates.back().first > hash )
+          candidates.pop_back();
+        candidates.emplace_back( hash, pos );
+      }
+
+      // Sequences shorter than a window make up a single window
+      if( pos + 1 < mWindow && pos + 1 < mNumKmers )
+        continue;
+
+      while( !candidates.empty() && candidates.front().second + mWindow <= pos )
+        candidates.pop_front();
+
+      if( !candidates.empty() && candidates.front().second != lastPos ) {
+        lastPos = candidates.front().second;
+        block( mKmers[ lastPos ], lastPos );
+      }
+    }
+  }
+
+  // Invertible mix, so no kmer order (e.g. poly-A first) is favored
+  static uint64_t Hash( Kmer kmer ) {
+    kmer ^= kmer >> 33;
+    kmer *= 0xFF51AFD7ED558CCDULL;
+    kmer ^= kmer >> 33;
+    kmer *= 0xC4CEB9FE1A85EC53ULL;
+    kmer ^= kmer >> 33;
+    return kmer;
+  }
+
+private:
+  const Kmer* mKmers;
+  size_t      mNumKmers;
+  size_t      mWindow;
+};
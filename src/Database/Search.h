@@ -6,7 +6,10 @@
 
 #include "../Alphabet/DNA.h"
 
+#include <algorithm>
 #include <deque>
+#include <iterator>
+#include <string>
 #include <vector>
 
 struct BaseSearchParams {
@@ -23,17 +26,23 @@ struct SearchParams< DNA > : public BaseSearchParams {
   DNA::Strand strand = DNA::Strand::Plus;
 };
 
+// Identifiers of the target's copies the database dropped, the hit
+// applies to them as well
+using DuplicateIdentifiers = std::vector< std::string >;
+
 template < typename Alphabet >
 struct Hit {
   Sequence< Alphabet > target;
   Cigar                alignment;
+  DuplicateIdentifiers duplicates;
 };
 
 template <>
 struct Hit< DNA > {
-  Sequence< DNA > target;
-  Cigar           alignment;
-  DNA::Strand     strand;
+  Sequence< DNA >      target;
+  Cigar                alignment;
+  DNA::Strand          strand;
+  DuplicateIdentifiers duplicates;
 };
 
 template < typename Alphabet >
@@ -42,9 +51,69 @@ using HitList = std::deque< Hit< Alphabet > >;
 template < typename Alphabet >
 using QueryHitsPair = std::pair< Sequence< Alphabet >, HitList< Alphabet > >;
 
+// Keeps the best maxAccepts hits (by identity)
+template < typename Alphabet >
+void KeepBestHits( HitList< Alphabet >* hits, const size_t maxAccepts ) {
+  std::stable_sort( hits->begin(), hits->end(),
+                    []( const Hit< Alphabet >& left, const Hit< Alphabet >& right ) {
+                      return left.alignment.Identity() > right.alignment.Identity();
+                    } );
+  if( hits->size() > maxAccepts )
+    hits->resize( maxAccepts );
+}
+
+// Merges the hits of a query found in different parts (shards) of the
+// database
+template < typename Alphabet >
+void MergeHits( HitList< Alphabet >* hits, HitList< Alphabet >&& moreHits,
+                const size_t maxAccepts ) {
+  std::move( moreHits.begin(), moreHits.end(), std::back_inserter( *hits ) );
+  KeepBestHits( hits, maxAccepts );
+}
+
+// maxAccepts applies per strand
+template <>
+inline void MergeHits( HitList< DNA >* hits, HitList< DNA >&& moreHits,
+                       const size_t maxAccepts ) {
+  HitList< DNA > byStrand[ 2 ];
+  for( auto list : { hits, &moreHits } ) {
+    for( auto& hit : *list ) {
+      byStrand[ hit.strand == DNA::Strand::Minus ].push_back( std::move( hit ) );
+    }
+  }
+
+  hits->clear();
+  for( auto& strandHits : byStrand ) {
+    KeepBestHits( &strandHits, maxAccepts );
+    std::move( strandHits.begin(), strandHits.end(), std::back_inserter( *hits ) );
+  }
+}
+
+// Every hit is reported for the target and each of its copies
+template < typename Alphabet >
+HitList< Alphabet > WithDuplicateHits( const HitList< Alphabet >& hits ) {
+  HitList< Alphabet > allHits;
+  for( auto& hit : hits ) {
+    allHits.push_back( hit );
+    allHits.back().duplicates.clear();
+
+    for( auto& identifier : hit.duplicates ) {
+      allHits.push_back( allHits.back() );
+      allHits.back().target.identifier = identifier;
+    }
+  }
+  return allHits;
+}
+
 template < typename Alphabet >
-using SearchForHitsCallback =
-  std::function< void( const Sequence< Alphabet >&, const Cigar& ) >;
+using SearchForHitsCallback = std::function< void(
+  const SequenceId, const Sequence< Alphabet >&, const Cigar& ) >;
+
+// Hits of the index-th query of a batch
+template < typename Alphabet >
+using BatchSearchForHitsCallback =
+  std::function< void( const size_t, const SequenceId,
+                       const Sequence< Alphabet >&, const Cigar& ) >;
 
 template < typename Alphabet >
 class Search {
@@ -56,19 +125,58 @@ public:
   inline HitList< Alphabet > Query( const Sequence< Alphabet >& query ) {
     HitList< Alphabet > hits;
 
-    SearchForHits(
-      query, [&]( const Sequence< Alphabet >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment } );
-      } );
+    SearchForHits( query, [&]( const SequenceId            seqId,
+                               const Sequence< Alphabet >& target,
+                               const Cigar&                alignment ) {
+      hits.push_back( { target, alignment, Duplicates( seqId ) } );
+    } );
+
+    return hits;
+  }
+
+  // Hits of each query, in the order of the queries
+  inline std::vector< HitList< Alphabet > >
+  Query( const SequenceList< Alphabet >& queries ) {
+    std::vector< HitList< Alphabet > > hits( queries.size() );
+
+    SearchForHits( queries, [&]( const size_t                index,
+                                 const SequenceId            seqId,
+                                 const Sequence< Alphabet >& target,
+                                 const Cigar&                alignment ) {
+      hits[ index ].push_back( { target, alignment, Duplicates( seqId ) } );
+    } );
 
     return hits;
   }
 
 protected:
+  DuplicateIdentifiers Duplicates( const SequenceId seqId ) const {
+    DuplicateIdentifiers duplicates;
+    mDB.ForEachDuplicateIdentifier( seqId, [&]( const std::string& identifier ) {
+      duplicates.push_back( identifier );
+    } );
+    return duplicates;
+  }
+
+
   virtual void
   SearchForHits( const Sequence< Alphabet >&              query,
                  const SearchForHitsCallback< Alphabet >& callback ) = 0;
 
+  // One query after the other, unless a search does better with all of
+  // them at hand
+  virtual void
+  SearchForHits( const SequenceList< Alphabet >&               queries,
+                 const BatchSearchForHitsCallback< Alphabet >& callback ) {
+    for( size_t i = 0; i < queries.size(); i++ ) {
+      SearchForHits( queries[ i ], [&]( const SequenceId            seqId,
+                                        const Sequence< Alphabet >& target,
+                                        const Cigar&                alignment ) {
+        callback( i, seqId, target, alignment );
+      } );
+    }
+  }
+
   const Database< Alphabet >&     mDB;
   const SearchParams< Alphabet >& mParams;
 };
@@ -83,18 +191,58 @@ inline HitList< DNA > Search< DNA >::Query( const Sequence< DNA >& query ) {
   auto strand = mParams.strand;
 
   if( strand == DNA::Strand::Plus || strand == DNA::Strand::Both ) {
-    SearchForHits(
-      query, [&]( const Sequence< DNA >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment, DNA::Strand::Plus } );
-      } );
+    SearchForHits( query, [&]( const SequenceId       seqId,
+                               const Sequence< DNA >& target,
+                               const Cigar&           alignment ) {
+      hits.push_back(
+        { target, alignment, DNA::Strand::Plus, Duplicates( seqId ) } );
+    } );
   }
 
   if( strand == DNA::Strand::Minus || strand == DNA::Strand::Both ) {
-    SearchForHits(
-      query.Reverse().Complement(),
-      [&]( const Sequence< DNA >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment, DNA::Strand::Minus } );
-      } );
+    SearchForHits( query.Reverse().Complement(),
+                   [&]( const SequenceId       seqId,
+                        const Sequence< DNA >& target,
+                        const Cigar&           alignment ) {
+      hits.push_back(
+        { target, alignment, DNA::Strand::Minus, Duplicates( seqId ) } );
+    } );
+  }
+
+  return hits;
+}
+
+// Each strand is searched as a query of its own: all plus strands, then
+// all minus strands (which rarely have kmers in common with the others)
+template <>
+inline std::vector< HitList< DNA > >
+Search< DNA >::Query( const SequenceList< DNA >& queries ) {
+  std::vector< HitList< DNA > > hits( queries.size() );
+
+  auto strand = mParams.strand;
+
+  if( strand == DNA::Strand::Plus || strand == DNA::Strand::Both ) {
+    SearchForHits( queries, [&]( const size_t           index,
+                                 const SequenceId       seqId,
+                                 const Sequence< DNA >& target,
+                                 const Cigar&           alignment ) {
+      hits[ index ].push_back(
+        { target, alignment, DNA::Strand::Plus, Duplicates( seqId ) } );
+    } );
+  }
+
+  if( strand == DNA::Strand::Minus || strand == DNA::Strand::Both ) {
+    SequenceList< DNA > minusStrands;
+    for( auto& query : queries )
+      minusStrands.push_back( query.Reverse().Complement() );
+
+    SearchForHits( minusStrands, [&]( const size_t           index,
+                                      const SequenceId       seqId,
+                                      const Sequence< DNA >& target,
+                                      const Cigar&           alignment ) {
+      hits[ index ].push_back(
+        { target, alignment, DNA::Strand::Minus, Duplicates( seqId ) } );
+    } );
   }
 
   return hits;
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "HSP.h"
+#include "Kmers.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Positions of the kmers of a query, built once and probed with the
+// kmers of each candidate (hash join). Open addressing, the positions
+// of every kmer are kept back to back in ascending order.
+class QueryKmerTable {
+public:
+  void Assign( const Kmer* kmers, const size_t numKmers ) {
+    for( mSlotBits = 1; ( size_t( 1 ) << mSlotBits ) < 2 * numKmers; mSlotBits++ )
+      ;
+    const size_t numSlots = size_t( 1 ) << mSlotBits;
+
+    mSlotKmers.assign( numSlots, AmbiguousKmer );
+    mOffsets.assign( numSlots + 1, 0 );
+    mSlotByPos.resize( numKmers );
+
+    for( size_t pos = 0; pos < numKmers; pos++ ) {
+      if( kmers[ pos ] == AmbiguousKmer )
+        continue;
+
+      size_t slot = HashSlot( kmers[ pos ] );
+      while( mSlotKmers[ slot ] != AmbiguousKmer &&
+             mSlotKmers[ slot ] != kmers[ pos ] ) {
+        slot = ( slot + 1 ) & ( numSlots - 1 );
+      }
+      mSlotKmers[ slot ] = kmers[ pos ];
+      mSlotByPos[ pos ]  = slot;
+      mOffsets[ slot + 1 ]++;
+    }
+
+    for( size_t slot = 0; slot < numSlots; slot++ ) {
+      mOffsets[ slot + 1 ] += mOffsets[ slot ];
+    }
+
+    mCursor.assign( mOffsets.begin(), mOffsets.end() - 1 );
+    mPositions.resize( mOffsets[ numSlots ] );
+    for( size_t pos = 0; pos < numKmers; pos++ ) {
+      if( kmers[ pos ] != AmbiguousKmer )
+        mPositions[ mCursor[ mSlotByPos[ pos ] ]++ ] = pos;
+    }
+  }
+
+  template < typename Callback >
+  void ForEachPosition( const Kmer kmer, const Callback& callback ) const {
+    if( mSlotKmers.empty() || kmer == AmbiguousKmer )
+      return;
+
+    size_t slot = HashSlot( kmer );
+    while( mSlotKmers[ slot ] != kmer ) {
+      if( mSlotKmers[ slot ] == AmbiguousKmer )
+        return;
+      slot = ( slot + 1 ) & ( mSlotKmers.size() - 1 );
+    }
+
+    for( size_t i = mOffsets[ slot ]; i < mOffsets[ slot + 1 ]; i++ ) {
+      callback( mPositions[ i ] );
+    }
+  }
+
+private:
+  size_t HashSlot( const Kmer kmer ) const {
+    return ( kmer * 0x9E3779B97F4A7C15ULL ) >> ( 64 - mSlotBits );
+  }
+
+  size_t                mSlotBits;
+  std::vector< Kmer >   mSlotKmers;
+  std::vector< size_t > mOffsets;
+  std::vector< size_t > mCursor;
+  std::vector< size_t > mSlotByPos;
+  std::vector< size_t > mPositions;
+};
+
+// Matching kmers of query (a) and candidate (b), by start position.
+// Seeds on the same diagonal at most maxGap apart are chained into
+// ungapped segment pairs (a2/b2 being the start of the last kmer).
+class Seeds {
+public:
+  void Clear() {
+    mSeeds.clear();
+  }
+
+  void Add( const size_t a, const size_t b ) {
+    mSeeds.emplace_back( a, b );
+  }
+
+  // Streams the kmers of a candidate through the query's table
+  void AddMatches( const QueryKmerTable& query, const Kmer* kmers,
+                   const size_t numKmers ) {
+    for( size_t b = 0; b < numKmers; b++ ) {
+      query.ForEachPosition( kmers[ b ], [&]( const size_t a ) { Add( a, b ); } );
+    }
+  }
+
+  void ToSegmentPairs( const size_t maxGap, std::vector< HSP >* sps ) {
+    sps->clear();
+
+    // By diagonal (b - a), then along it
+    std::sort( mSeeds.begin(), mSeeds.end(),
+               []( const Seed& left, const Seed& right ) {
+                 const size_t l = left.second + right.first;
+                 const size_t r = right.second + left.first;
+                 return l < r || ( l == r && left.first < right.first );
+               } );
+
+    for( size_t i = 0; i < mSeeds.size(); ) {
+      size_t j = i + 1;
+      while( j < mSeeds.size() &&
+             mSeeds[ j ].second - mSeeds[ j ].first ==
+               mSeeds[ i ].second - mSeeds[ i ].first &&
+             mSeeds[ j ].first - mSeeds[ j - 1 ].first <= maxGap ) {
+        j++;
+      }
+
+      sps->emplace_back( mSeeds[ i ].first, mSeeds[ j - 1 ].first,
+                         mSeeds[ i ].second, mSeeds[ j - 1 ].second );
+      i = j;
+    }
+
+    // In order of query, then candidate position
+    std::sort( sps->begin(), sps->end(), []( const HSP& left, const HSP& right ) {
+      return left.a1 < right.a1 || ( left.a1 == right.a1 && left.b1 < right.b1 );
+    } );
+  }
+
+private:
+  using Seed = std::pair< size_t, size_t >;
+
+  std::vector< Seed > mSeeds;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+// Read-only array which either owns its elements or refers to memory
+// owned by someone else (e.g. a memory mapped index file)
+template < typename T >
+class Storage {
+public:
+  Storage() : mData( NULL ), mSize( 0 ) {}
+
+  Storage( const Storage< T >& other ) {
+    *this = other;
+  }
+
+  Storage< T >& operator=( const Storage< T >& other ) {
+    mOwned = other.mOwned;
+    mData  = other.IsOwned() ? mOwned.data() : other.mData;
+    mSize  = other.mSize;
+    return *this;
+  }
+
+  Storage( Storage< T >&& other ) {
+    *this = std::move( other );
+  }
+
+  Storage< T >& operator=( Storage< T >&& other ) {
+    const bool owned = other.IsOwned();
+    mOwned = std::move( other.mOwned );
+    mData  = owned ? mOwned.data() : other.mData;
+    mSize  = other.mSize;
+    return *this;
+  }
+
+  void Assign( std::vector< T >&& values ) {
+    mOwned = std::move( values );
+    mData  = mOwned.data();
+    mSize  = mOwned.size();
+  }
+
+  void Map( const T* data, const size_t size ) {
+    mOwned.clear();
+    mOwned.shrink_to_fit();
+    mData = data;
+    mSize = size;
+  }
+
+  bool IsOwned() const {
+    return mData == mOwned.data() && mSize == mOwned.size();
+  }
+
+  inline const T& operator[]( const size_t index ) const {
+    assert( index < mSize );
+    return mData[ index ];
+  }
+
+  inline const T* data() const {
+    return mData;
+  }
+
+  inline size_t size() const {
+    return mSize;
+  }
+
+  inline bool empty() const {
+    return mSize == 0;
+  }
+
+private:
+  std::vector< T > mOwned;
+  const T*         mData;
+  size_t           mSize;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Index {
+
+/*
+ * On-disk layout of a database index:
+ *
+ *   [Header][Section][Section]...
+ *
+ * Every section starts 8-byte aligned, so the tables can be used
+ * directly from a read-only memory mapping of the file.
+ */
+static const char     Magic[ 8 ]    = { 'B', 'L', 'A', 'S', 'T', 'I', 'D', 'X' };
+static const uint32_t Version       = 9;
+static const uint32_t ByteOrderMark = 0x01020304;
+static const size_t   Alignment     = 8;
+static const size_t   MaxSections   = 32;
+
+// How the posting lists (sequence ids by kmer) are stored
+enum SequenceIdsEncoding {
+  SequenceIdsPlain       = 0,
+  SequenceIdsDeltaVarint = 1,
+};
+
+enum KmerTable {
+  DenseKmerTable  = 0,
+  SparseKmerTable = 1,
+};
+
+struct SectionEntry {
+  uint64_t offset; // bytes from beginning of file
+  uint64_t size;   // bytes
+};
+
+struct Header {
+  char     magic[ 8 ];
+  uint32_t version;
+  uint32_t byteOrderMark;
+
+  // Database parameters
+  uint32_t alphabetBits;
+  uint32_t kmerBytes;
+  uint32_t sequenceIdBytes;
+  uint32_t offsetBytes;
+  uint64_t kmerLength;
+  uint64_t numSequences;
+  uint32_t kmerTable;
+  uint32_t sequenceIdsOffsetBytes;
+  uint32_t sequenceIdsEncoding;
+  uint32_t minimizerWindow;
+  uint32_t dereplicated;
+  uint32_t positionalPostings;
+
+  SectionEntry sections[ MaxSections ];
+};
+
+static inline bool HasMagic( const char* data, const size_t size ) {
+  return size >= sizeof( Magic ) &&
+         memcmp( data, Magic, sizeof( Magic ) ) == 0;
+}
+
+} // namespace Index
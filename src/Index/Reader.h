@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Format.h"
+#include "../MappedFile.h"
+
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace Index {
+
+class Reader {
+public:
+  Reader( const std::string& pathToFile )
+      : mPath( pathToFile ), mFile( new MappedFile( pathToFile ) ) {
+    if( mFile->Size() < sizeof( Header ) ||
+        !HasMagic( mFile->Data(), mFile->Size() ) )
+      throw std::runtime_error( pathToFile + " is not a database index" );
+
+    mHeader = ( const Header* ) mFile->Data();
+    if( mHeader->version != Version )
+      throw std::runtime_error( pathToFile +
+                                " was built by an incompatible version" );
+    if( mHeader->byteOrderMark != ByteOrderMark )
+      throw std::runtime_error( pathToFile +
+                                " was built on an incompatible platform" );
+  }
+
+  const Header& GetHeader() const {
+    return *mHeader;
+  }
+
+  // Keeps the mapping alive for as long as the tables are in use
+  std::shared_ptr< MappedFile > File() const {
+    return mFile;
+  }
+
+  template < typename T >
+  const T* Get( const size_t section, size_t* count ) const {
+    const SectionEntry& entry = mHeader->sections[ section ];
+    if( entry.offset % Alignment || entry.size % sizeof( T ) ||
+        entry.size > mFile->Size() ||
+        entry.offset > mFile->Size() - entry.size )
+      throw std::runtime_error( mPath + " is corrupt" );
+
+    *count = entry.size / sizeof( T );
+    return ( const T* ) ( mFile->Data() + entry.offset );
+  }
+
+  static bool IsIndexFile( const std::string& pathToFile ) {
+    std::ifstream file( pathToFile, std::ios::in | std::ios::binary );
+    char          magic[ sizeof( Magic ) ];
+    if( !file.read( magic, sizeof( magic ) ) )
+      return false;
+    return HasMagic( magic, sizeof( magic ) );
+  }
+
+private:
+  std::string                   mPath;
+  std::shared_ptr< MappedFile > mFile;
+  const Header*                 mHeader;
+};
+
+} // namespace Index
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Format.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace Index {
+
+class Writer {
+public:
+  Writer( const std::string& pathToFile )
+      : mPath( pathToFile ),
+        mFile( pathToFile, std::ios::out | std::ios::binary | std::ios::trunc ) {
+    if( !mFile )
+      throw std::runtime_error( "Cannot write " + pathToFile );
+
+    memset( &mHeader, 0, sizeof( mHeader ) );
+    memcpy( mHeader.magic, Magic, sizeof( Magic ) );
+    mHeader.version       = Version;
+    mHeader.byteOrderMark = ByteOrderMark;
+
+    // Reserve space for header, written on Finish
+    mFile.write( ( const char* ) &mHeader, sizeof( mHeader ) );
+  }
+
+  Header& GetHeader() {
+    return mHeader;
+  }
+
+  template < typename T >
+  void Write( const size_t section, const T* data, const size_t count ) {
+    Pad();
+
+    SectionEntry& entry = mHeader.sections[ section ];
+    entry.offset        = mFile.tellp();
+    entry.size          = count * sizeof( T );
+    if( entry.size > 0 )
+      mFile.write( ( const char* ) data, entry.size );
+  }
+
+  void Finish() {
+    Pad();
+    mFile.seekp( 0 );
+    mFile.write( ( const char* ) &mHeader, sizeof( mHeader ) );
+    mFile.close();
+
+    if( !mFile )
+      throw std::runtime_error( "Failed writing " + mPath );
+  }
+
+private:
+  void Pad() {
+    static const char zeros[ Alignment ] = { 0 };
+    size_t pos = mFile.tellp();
+    if( pos % Alignment )
+      mFile.write( zeros, Alignment - pos % Alignment );
+  }
+
+  std::string   mPath;
+  std::ofstream mFile;
+  Header        mHeader;
+};
+
+} // namespace Index
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+  MappedFile( const std::string& path ) : mData( NULL ), mSize( 0 ) {
+#ifdef _WIN32
+    mFile    = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+
+    mFile = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( mFile == INVALID_HANDLE_VALUE )
+      throw std::runtime_error( "Cannot open " + path );
+
+    LARGE_INTEGER size;
+    GetFileSizeEx( mFile, &size );
+    mSize = size.QuadPart;
+
+    if( mSize > 0 ) {
+      mMapping = CreateFileMappingA( mFile, NULL, PAGE_READONLY, 0, 0, NULL );
+      if( mMapping )
+        mData = ( const char* ) MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 );
+    }
+#else
+    int fd = open( path.c_str(), O_RDONLY );
+    if( fd == -1 )
+      throw std::runtime_error( "Cannot open " + path );
+
+    struct stat st;
+    if( fstat( fd, &st ) == 0 )
+      mSize = st.st_size;
+
+    if( mSize > 0 ) {
+      void* addr = mmap( NULL, mSize, PROT_READ, MAP_SHARED, fd, 0 );
+      if( addr != MAP_FAILED )
+        mData = ( const char* ) addr;
+    }
+    close( fd );
+#endif
+
+    if( mSize > 0 && !mData ) {
+      Unmap();
+      throw std::runtime_error( "Cannot map " + path + " into memory" );
+    }
+  }
+
+  ~MappedFile() {
+    Unmap();
+  }
+
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  const char* Data() const {
+    return mData;
+  }
+
+  size_t Size() const {
+    return mSize;
+  }
+
+private:
+  void Unmap() {
+#ifdef _WIN32
+    if( mData )
+      UnmapViewOfFile( mData );
+    if( mMapping )
+      CloseHandle( mMapping );
+    if( mFile != INVALID_HANDLE_VALUE )
+      CloseHandle( mFile );
+    mMapping = NULL;
+    mFile    = INVALID_HANDLE_VALUE;
+#else
+    if( mData )
+      munmap( ( void* ) mData, mSize );
+#endif
+    mData = NULL;
+  }
+
+#ifdef _WIN32
+  HANDLE mFile;
+  HANDLE mMapping;
+#endif
+
+  const char* mData;
+  size_t      mSize;
+};
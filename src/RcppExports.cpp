@@ -37,33 +37,158 @@ BEGIN_RCPP
 END_RCPP
 }
 // dna_blast
-void dna_blast(std::string query_table, std::string db_table, std::string output_file, int maxAccepts, int maxRejects, double minIdentity, std::string strand);
-RcppExport SEXP _blaster_dna_blast(SEXP query_tableSEXP, SEXP db_tableSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP, SEXP strandSEXP) {
+void dna_blast(std::string query_table, std::vector< std::string > db_tables, std::string output_file, int maxAccepts, int maxRejects, double minIdentity, std::string strand, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_dna_blast(SEXP query_tableSEXP, SEXP db_tablesSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP, SEXP strandSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type query_table(query_tableSEXP);
-    Rcpp::traits::input_parameter< std::string >::type db_table(db_tableSEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type db_tables(db_tablesSEXP);
     Rcpp::traits::input_parameter< std::string >::type output_file(output_fileSEXP);
     Rcpp::traits::input_parameter< int >::type maxAccepts(maxAcceptsSEXP);
     Rcpp::traits::input_parameter< int >::type maxRejects(maxRejectsSEXP);
     Rcpp::traits::input_parameter< double >::type minIdentity(minIdentitySEXP);
     Rcpp::traits::input_parameter< std::string >::type strand(strandSEXP);
-    dna_blast(query_table, db_table, output_file, maxAccepts, maxRejects, minIdentity, strand);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    dna_blast(query_table, db_tables, output_file, maxAccepts, maxRejects, minIdentity, strand, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize);
     return R_NilValue;
 END_RCPP
 }
 // protein_blast
-void protein_blast(std::string query_table, std::string db_table, std::string output_file, int maxAccepts, int maxRejects, double minIdentity);
-RcppExport SEXP _blaster_protein_blast(SEXP query_tableSEXP, SEXP db_tableSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP) {
+void protein_blast(std::string query_table, std::vector< std::string > db_tables, std::string output_file, int maxAccepts, int maxRejects, double minIdentity, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_protein_blast(SEXP query_tableSEXP, SEXP db_tablesSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type query_table(query_tableSEXP);
+    Rcpp::traits::input_parameter< std::vector< std::string > >::type db_tables(db_tablesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output_file(output_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type maxAccepts(maxAcceptsSEXP);
+    Rcpp::traits::input_parameter< int >::type maxRejects(maxRejectsSEXP);
+    Rcpp::traits::input_parameter< double >::type minIdentity(minIdentitySEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    protein_blast(query_table, db_tables, output_file, maxAccepts, maxRejects, minIdentity, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize);
+    return R_NilValue;
+END_RCPP
+}
+// build_dna_index
+std::vector< std::string > build_dna_index(std::string db_table, std::string index_file, bool compress, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_build_dna_index(SEXP db_tableSEXP, SEXP index_fileSEXP, SEXP compressSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type db_table(db_tableSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type compress(compressSEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(build_dna_index(db_table, index_file, compress, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+// build_protein_index
+std::vector< std::string > build_protein_index(std::string db_table, std::string index_file, bool compress, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_build_protein_index(SEXP db_tableSEXP, SEXP index_fileSEXP, SEXP compressSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type db_table(db_tableSEXP);
+    Rcpp::traits::input_parameter< std::string >::type index_file(index_fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type compress(compressSEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(build_protein_index(db_table, index_file, compress, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+// build_dna_db
+SEXP build_dna_db(std::string db_table, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional);
+RcppExport SEXP _blaster_build_dna_db(SEXP db_tableSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type db_table(db_tableSEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    rcpp_result_gen = Rcpp::wrap(build_dna_db(db_table, seedMask, window, maxKmerFrequency, dereplicate, positional));
+    return rcpp_result_gen;
+END_RCPP
+}
+// build_protein_db
+SEXP build_protein_db(std::string db_table, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional);
+RcppExport SEXP _blaster_build_protein_db(SEXP db_tableSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type db_table(db_tableSEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    rcpp_result_gen = Rcpp::wrap(build_protein_db(db_table, seedMask, window, maxKmerFrequency, dereplicate, positional));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dna_blast_db
+void dna_blast_db(std::string query_table, SEXP db, std::string output_file, int maxAccepts, int maxRejects, double minIdentity, std::string strand, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_dna_blast_db(SEXP query_tableSEXP, SEXP dbSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP, SEXP strandSEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type query_table(query_tableSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type db(dbSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output_file(output_fileSEXP);
+    Rcpp::traits::input_parameter< int >::type maxAccepts(maxAcceptsSEXP);
+    Rcpp::traits::input_parameter< int >::type maxRejects(maxRejectsSEXP);
+    Rcpp::traits::input_parameter< double >::type minIdentity(minIdentitySEXP);
+    Rcpp::traits::input_parameter< std::string >::type strand(strandSEXP);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    dna_blast_db(query_table, db, output_file, maxAccepts, maxRejects, minIdentity, strand, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize);
+    return R_NilValue;
+END_RCPP
+}
+// protein_blast_db
+void protein_blast_db(std::string query_table, SEXP db, std::string output_file, int maxAccepts, int maxRejects, double minIdentity, std::string seedMask, int window, double maxKmerFrequency, bool dereplicate, bool positional, double shardSize);
+RcppExport SEXP _blaster_protein_blast_db(SEXP query_tableSEXP, SEXP dbSEXP, SEXP output_fileSEXP, SEXP maxAcceptsSEXP, SEXP maxRejectsSEXP, SEXP minIdentitySEXP, SEXP seedMaskSEXP, SEXP windowSEXP, SEXP maxKmerFrequencySEXP, SEXP dereplicateSEXP, SEXP positionalSEXP, SEXP shardSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type query_table(query_tableSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type db(dbSEXP);
     Rcpp::traits::input_parameter< std::string >::type output_file(output_fileSEXP);
     Rcpp::traits::input_parameter< int >::type maxAccepts(maxAcceptsSEXP);
     Rcpp::traits::input_parameter< int >::type maxRejects(maxRejectsSEXP);
     Rcpp::traits::input_parameter< double >::type minIdentity(minIdentitySEXP);
-    protein_blast(query_table, db_table, output_file, maxAccepts, maxRejects, minIdentity);
+    Rcpp::traits::input_parameter< std::string >::type seedMask(seedMaskSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type maxKmerFrequency(maxKmerFrequencySEXP);
+    Rcpp::traits::input_parameter< bool >::type dereplicate(dereplicateSEXP);
+    Rcpp::traits::input_parameter< bool >::type positional(positionalSEXP);
+    Rcpp::traits::input_parameter< double >::type shardSize(shardSizeSEXP);
+    protein_blast_db(query_table, db, output_file, maxAccepts, maxRejects, minIdentity, seedMask, window, maxKmerFrequency, dereplicate, positional, shardSize);
     return R_NilValue;
 END_RCPP
 }
@@ -71,8 +196,14 @@ END_RCPP
 static const R_CallMethodDef CallEntries[] = {
     {"_blaster_read_dna_fasta", (DL_FUNC) &_blaster_read_dna_fasta, 3},
     {"_blaster_read_protein_fasta", (DL_FUNC) &_blaster_read_protein_fasta, 3},
-    {"_blaster_dna_blast", (DL_FUNC) &_blaster_dna_blast, 7},
-    {"_blaster_protein_blast", (DL_FUNC) &_blaster_protein_blast, 6},
+    {"_blaster_dna_blast", (DL_FUNC) &_blaster_dna_blast, 13},
+    {"_blaster_protein_blast", (DL_FUNC) &_blaster_protein_blast, 12},
+    {"_blaster_build_dna_index", (DL_FUNC) &_blaster_build_dna_index, 9},
+    {"_blaster_build_protein_index", (DL_FUNC) &_blaster_build_protein_index, 9},
+    {"_blaster_build_dna_db", (DL_FUNC) &_blaster_build_dna_db, 6},
+    {"_blaster_build_protein_db", (DL_FUNC) &_blaster_build_protein_db, 6},
+    {"_blaster_dna_blast_db", (DL_FUNC) &_blaster_dna_blast_db, 13},
+    {"_blaster_protein_blast_db", (DL_FUNC) &_blaster_protein_blast_db, 12},
     {NULL, NULL, 0}
 };
 
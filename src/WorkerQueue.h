@@ -6,6 +6,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <exception>
 
 template < typename T >
 class QueueItemInfo {
@@ -22,8 +23,8 @@ public:
     std::function< void( const size_t, const size_t ) >;
 
   WorkerQueue( const int numWorkers = 1, Args... args )
-      : mStop( false ), mWorkingCount( 0 ), mTotalEnqueued( 0 ),
-        mTotalProcessed( 0 ) {
+      : mStop( false ), mWorkingCount( 0 ), mFailed( false ),
+        mTotalEnqueued( 0 ), mTotalProcessed( 0 ) {
     auto actualWorkers =
       numWorkers <= 0 ? std::thread::hardware_concurrency() : numWorkers;
 
@@ -61,10 +62,16 @@ public:
     return mWorkingCount == 0 && mQueue.empty();
   }
 
+  // Rethrows the exception of a failed item, the queue stops at the first
   void WaitTillDone() {
-    while( !Done() ) {
+    while( !Done() && !mFailed ) {
       std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
     }
+
+    if( mFailed ) {
+      std::unique_lock< std::mutex > lock( mQueueMutex );
+      std::rethrow_exception( mError );
+    }
   }
 
   void OnProcessed( const OnProcessedCallback& callback ) {
@@ -78,6 +85,8 @@ private:
   std::mutex              mQueueMutex;
   std::atomic< bool >     mStop;
   std::atomic< int >      mWorkingCount;
+  std::atomic< bool >     mFailed;
+  std::exception_ptr      mError;
 
   std::queue< QueueItem > mQueue;
 
@@ -105,10 +114,26 @@ private:
         mWorkingCount++;
       } // release lock
 
-      worker.Process( queueItem );
+      std::exception_ptr error;
+      try {
+        worker.Process( queueItem );
+      } catch( ... ) {
+        error = std::current_exception();
+      }
 
       { // acquire lock
         std::unique_lock< std::mutex > lock( mQueueMutex );
+        if( error ) {
+          mWorkingCount--;
+          if( !mFailed ) {
+            mError  = error;
+            mFailed = true;
+          }
+          mStop = true;
+          mCondition.notify_all();
+          break;
+        }
+
         mTotalProcessed += QueueItemInfo< QueueItem >::Count( queueItem );
         mWorkingCount--;
 
@@ -44,7 +44,8 @@ public:
 
   void Process( const QueryWithHitsList< A >& queryWithHitsList ) {
     for( auto& queryWithHits : queryWithHitsList ) {
-      ( *mWriter ) << queryWithHits;
+      ( *mWriter ) << QueryWithHits< A >( queryWithHits.first,
+                                          WithDuplicateHits( queryWithHits.second ) );
     }
   }
 
@@ -77,12 +78,12 @@ public:
   void Process( const SequenceList< A >& queries ) {
     QueryWithHitsList< A > list;
 
-    for( auto& query : queries ) {
-      auto hits = mGlobalSearch.Query( query );
-      if( hits.empty() )
+    auto hits = mGlobalSearch.Query( queries );
+    for( size_t i = 0; i < queries.size(); i++ ) {
+      if( hits[ i ].empty() )
         continue;
 
-      list.push_back( { query, hits } );
+      list.push_back( { queries[ i ], std::move( hits[ i ] ) } );
     }
 
     if( !list.empty() ) {
@@ -111,106 +112,365 @@ struct WordSize< Protein > {
   static const int VALUE = 5;
 };
 
-std::string DFtoSeq(DataFrame seq_table)
-{
-  std::vector< std::string > ids = seq_table["Id"];
-  std::vector< std::string > seqs = seq_table["Seq"];
-  
-  std::stringstream content;
+enum ProgressType {
+                   ReadDBFile,
+                   StatsDB,
+                   IndexDB,
+                   ReadQueryFile,
+                   SearchDB,
+                   WriteHits
+};
 
-  for (int i{0}; i < ids.size(); ++i) {
-    std::string id{ids[i]};
-    std::string seq{seqs[i]};
-    content << ">" << id << "\n" << seq << "\n";
+void AddProgressStages( ProgressOutput& progress ) {
+  progress.Add( ProgressType::ReadDBFile, "Read database", UnitType::BYTES );
+  progress.Add( ProgressType::StatsDB, "Analyze database" );
+  progress.Add( ProgressType::IndexDB, "Index database" );
+  progress.Add( ProgressType::ReadQueryFile, "Read queries", UnitType::BYTES );
+  progress.Add( ProgressType::SearchDB, "Search database" );
+  progress.Add( ProgressType::WriteHits, "Write hits" );
+}
+
+// Reads database sequences until they add up to shardSize residues
+// (0 = up to the end of the file)
+template < typename A >
+void ReadDatabase( SequenceReader< A >& dbReader, const size_t shardSize,
+                   SequenceList< A >* sequences, ProgressOutput& progress ) {
+  Sequence< A > seq;
+  size_t numResidues = 0;
+
+  progress.Activate( ProgressType::ReadDBFile );
+  while( !dbReader.EndOfFile() &&
+         ( shardSize == 0 || numResidues < shardSize ) ) {
+    dbReader >> seq;
+    numResidues += seq.Length();
+    sequences->push_back( std::move( seq ) );
+    progress.Set( ProgressType::ReadDBFile, dbReader.NumBytesRead(),
+                  dbReader.NumBytesTotal() );
   }
-  return content.str();
 }
 
+template < typename A >
+void IndexDatabase( const SequenceList< A >& sequences, Database< A >* db,
+                    ProgressOutput& progress ) {
+  db->SetProgressCallback(
+                          [&]( typename Database< A >::ProgressType type, size_t num, size_t total ) {
+                            switch( type ) {
+                            case Database< A >::ProgressType::StatsCollection:
+                              progress.Activate( ProgressType::StatsDB )
+                                .Set( ProgressType::StatsDB, num, total );
+                              break;
+
+                            case Database< A >::ProgressType::Indexing:
+                              progress.Activate( ProgressType::IndexDB )
+                                .Set( ProgressType::IndexDB, num, total );
+                              break;
+
+                            default:
+                              break;
+                            }
+                          } );
+  try {
+    db->Initialize( sequences );
+  } catch( const std::exception& e ) {
+    stop( e.what() );
+  }
+}
 
-// [[Rcpp::export]]
-void dna_blast(std::string query_table,
-               std::string db_table,
-               std::string output_file,
-               int maxAccepts = 1,
-               int maxRejects =  16,
-               double minIdentity = 0.75,
-               std::string strand = "both") 
-{
+template < typename A >
+void BuildDatabase( const std::string& db_table, Database< A >* db,
+                    ProgressOutput& progress ) {
+  std::unique_ptr< SequenceReader< A > > dbReader( new FASTA::Reader< A >( db_table ) );
 
-  std::unique_ptr< SequenceReader< DNA > > dbReader( new FASTA::Reader< DNA >( db_table ) );
-  
-  Sequence< DNA > seq;
-  SequenceList< DNA > sequences;
+  SequenceList< A > sequences;
+  ReadDatabase( *dbReader, 0, &sequences, progress );
+  IndexDatabase( sequences, db, progress );
+}
 
-  while( !( dbReader->EndOfFile() ) ) {
-    ( *dbReader ) >> seq;
-    sequences.push_back( std::move( seq ) );
+// An empty seed mask selects the default (contiguous) seed
+template < typename A >
+void SetSeedMask( const std::string& seedMask, Database< A >* db ) {
+  if( seedMask.empty() )
+    return;
+
+  try {
+    db->SetSeedMask( SeedMask( seedMask ) );
+  } catch( const std::exception& e ) {
+    stop( e.what() );
   }
+}
+
+// A window of 0 selects the default (every kmer indexed)
+template < typename A >
+void SetMinimizerWindow( const int window, Database< A >* db ) {
+  if( window == 0 )
+    return;
+
+  if( window < 0 )
+    stop( "Window must be a positive number." );
+
+  db->SetMinimizerWindow( window );
+}
+
+// Kmers found in more sequences than maxFrequency are masked. Below 1 it
+// is a quantile of the kmer frequencies instead, 0 means no limit.
+template < typename A >
+void SetMaxKmerFrequency( const double maxFrequency, Database< A >* db ) {
+  if( maxFrequency < 0 )
+    stop( "Max kmer frequency must be a positive number." );
+
+  if( maxFrequency >= 1 )
+    db->SetMaxKmerFrequency( size_t( maxFrequency ) );
+  else if( maxFrequency > 0 )
+    db->SetMaxKmerFrequencyPercentile( 100 * maxFrequency );
+}
+
+// The indexing options of a built database (prebuilt index or blast_db)
+// can't be changed, giving a different one is an error. The kmer
+// frequency limit isn't kept, only the kmers it masked.
+template < typename A >
+void CheckDatabaseOptions( const Database< A >& db, const std::string& seedMask,
+                           const int window, const double maxKmerFrequency,
+                           const bool dereplicate, const bool positional ) {
+  if( !seedMask.empty() && seedMask != db.GetSeedMask().Pattern() )
+    stop( "The database was built with seed mask " +
+          db.GetSeedMask().Pattern() );
+
+  if( window != 0 && size_t( window ) != db.GetMinimizerWindow() )
+    stop( "The database was built with window " +
+          std::to_string( db.GetMinimizerWindow() ) );
+
+  if( maxKmerFrequency != 0 )
+    stop( "The max kmer frequency is applied when the database is built." );
 
+  if( dereplicate && !db.IsDereplicated() )
+    stop( "The database was built without dereplicate." );
+
+  if( positional && !db.HasPositionalPostings() )
+    stop( "The database was built without positional postings." );
+}
+
+template < typename A >
+void LoadDatabase( const std::string& db_table, const std::string& seedMask,
+                   const int window, const double maxKmerFrequency,
+                   const bool dereplicate, const bool positional,
+                   Database< A >* db, ProgressOutput& progress ) {
+  if( !Index::Reader::IsIndexFile( db_table ) ) {
+    SetSeedMask( seedMask, db );
+    SetMinimizerWindow( window, db );
+    SetMaxKmerFrequency( maxKmerFrequency, db );
+    db->SetDereplicate( dereplicate );
+    db->SetPositionalPostings( positional );
+    BuildDatabase( db_table, db, progress );
+    return;
+  }
+
+  // Prebuilt index, tables are memory mapped instead of rebuilt
+  progress.Activate( ProgressType::ReadDBFile );
+  try {
+    db->Load( db_table );
+  } catch( const std::exception& e ) {
+    stop( e.what() );
+  }
+  progress.Set( ProgressType::ReadDBFile, 1, 1 );
+
+  CheckDatabaseOptions( *db, seedMask, window, maxKmerFrequency, dereplicate,
+                        positional );
+}
+
+// A shard size of 0 means the database isn't split
+size_t ShardSize( const double shardSize ) {
+  if( shardSize < 0 )
+    stop( "Shard size must be a positive number." );
+
+  return size_t( shardSize );
+}
+
+// With a shard size, one index file per shard is written
+// (<index_file>.1, <index_file>.2, ...)
+template < typename A >
+std::vector< std::string >
+BuildIndex( const std::string& db_table, const std::string& index_file,
+            const bool compress, const std::string& seedMask,
+            const int window, const double maxKmerFrequency,
+            const bool dereplicate, const bool positional,
+            const size_t shardSize ) {
   ProgressOutput progress;
+  AddProgressStages( progress );
+
+  std::unique_ptr< SequenceReader< A > > dbReader( new FASTA::Reader< A >( db_table ) );
+  std::vector< std::string > indexFiles;
+
+  do {
+    SequenceList< A > sequences;
+    ReadDatabase( *dbReader, shardSize, &sequences, progress );
+
+    Database< A > db( WordSize< A >::VALUE );
+    db.SetCompressSequenceIds( compress );
+    SetSeedMask( seedMask, &db );
+    SetMinimizerWindow( window, &db );
+    SetMaxKmerFrequency( maxKmerFrequency, &db );
+    db.SetDereplicate( dereplicate );
+    db.SetPositionalPostings( positional );
+    IndexDatabase( sequences, &db, progress );
+
+    indexFiles.push_back( shardSize > 0 ? index_file + "." +
+                                            std::to_string( indexFiles.size() + 1 )
+                                        : index_file );
+    try {
+      db.Save( indexFiles.back() );
+    } catch( const std::exception& e ) {
+      stop( e.what() );
+    }
+  } while( !dbReader->EndOfFile() );
 
-  enum ProgressType {
-                     ReadDBFile,
-                     StatsDB,
-                     IndexDB,
-                     ReadQueryFile,
-                     SearchDB,
-                     WriteHits
+  Rcout << "\n";
+
+  return indexFiles;
+}
+
+using QueryRange = std::pair< size_t, size_t >;
+
+template <>
+class QueueItemInfo< QueryRange > {
+public:
+  static size_t Count( const QueryRange& range ) {
+    return range.second - range.first;
+  }
+};
+
+// Searches queries against one shard of the database, merging the hits
+// into those of the previous shards
+template < typename A >
+class QueryShardSearcherWorker {
+public:
+  QueryShardSearcherWorker( const SequenceList< A >*     queries,
+                            std::vector< HitList< A > >* hits,
+                            const Database< A >*         database,
+                            const SearchParams< A >&     params )
+    : mQueries( *queries ),
+      mHits( *hits ),
+      mMaxAccepts( params.maxAccepts ),
+      mGlobalSearch( *database, params ) {}
+
+  void Process( const QueryRange& range ) {
+    SequenceList< A > queries( mQueries.begin() + range.first,
+                               mQueries.begin() + range.second );
+
+    auto hits = mGlobalSearch.Query( queries );
+    for( size_t i = range.first; i < range.second; i++ ) {
+      MergeHits( &mHits[ i ], std::move( hits[ i - range.first ] ), mMaxAccepts );
+    }
+  }
+
+private:
+  const SequenceList< A >&     mQueries;
+  std::vector< HitList< A > >& mHits;
+  size_t                       mMaxAccepts;
+  GlobalSearch< A >            mGlobalSearch;
+};
+
+template < typename A >
+using QueryShardSearcher =
+  WorkerQueue< QueryShardSearcherWorker< A >, QueryRange,
+               const SequenceList< A >*, std::vector< HitList< A > >*,
+               const Database< A >*, const SearchParams< A >& >;
+
+// Only one shard of the database is held in memory at a time: either a
+// part of shardSize residues of a FASTA file or a prebuilt index file.
+// All queries are searched against each shard in turn.
+template < typename A >
+void SearchShards( const std::string&                query_table,
+                   const std::vector< std::string >& db_tables,
+                   const std::string&                output_file,
+                   const SearchParams< A >&          searchParams,
+                   const std::string& seedMask, const int window,
+                   const double maxKmerFrequency, const bool dereplicate,
+                   const bool positional, const size_t shardSize ) {
+  const size_t numQueriesPerWorkItem = 64;
+
+  // Index files are searched whole, they are sharded when built
+  for( auto& db_table : db_tables ) {
+    if( shardSize > 0 && Index::Reader::IsIndexFile( db_table ) )
+      stop( db_table + " is an index, its shards are set by build_index()." );
+  }
+
+  ProgressOutput progress;
+  AddProgressStages( progress );
+
+  std::unique_ptr< SequenceReader< A > > qryReader( new FASTA::Reader< A >( query_table ) );
+
+  SequenceList< A > queries;
+  progress.Activate( ProgressType::ReadQueryFile );
+  while( !qryReader->EndOfFile() ) {
+    qryReader->Read( numQueriesPerWorkItem, &queries );
+    progress.Set( ProgressType::ReadQueryFile, qryReader->NumBytesRead(),
+                  qryReader->NumBytesTotal() );
+  }
+
+  std::vector< HitList< A > > hits( queries.size() );
+
+  auto searchShard = [&]( const Database< A >& db ) {
+    QueryShardSearcher< A > searcher( -1, &queries, &hits, &db, searchParams );
+    searcher.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
+                            progress.Set( ProgressType::SearchDB, numProcessed, numEnqueued );
+                          } );
+
+    progress.Activate( ProgressType::SearchDB );
+    for( size_t i = 0; i < queries.size(); i += numQueriesPerWorkItem ) {
+      QueryRange range( i, std::min( i + numQueriesPerWorkItem, queries.size() ) );
+      searcher.Enqueue( range );
+    }
+    searcher.WaitTillDone();
   };
 
-  progress.Add( ProgressType::ReadDBFile, "Read database", UnitType::BYTES );
-  progress.Add( ProgressType::StatsDB, "Analyze database" );
-  progress.Add( ProgressType::IndexDB, "Index database" );
-  progress.Add( ProgressType::ReadQueryFile, "Read queries", UnitType::BYTES );
-  progress.Add( ProgressType::SearchDB, "Search database" );
-  progress.Add( ProgressType::WriteHits, "Write hits" );
+  for( auto& db_table : db_tables ) {
+    if( Index::Reader::IsIndexFile( db_table ) ) {
+      Database< A > db( WordSize< A >::VALUE );
+      LoadDatabase( db_table, seedMask, window, maxKmerFrequency, dereplicate,
+                    positional, &db, progress );
+      searchShard( db );
+      continue;
+    }
 
-  // Read DB
-  progress.Activate( ProgressType::ReadDBFile );
-  while( !dbReader->EndOfFile() ) {
-    ( *dbReader ) >> seq;
-    sequences.push_back( std::move( seq ) );
-    progress.Set( ProgressType::ReadDBFile, dbReader->NumBytesRead(),
-                  dbReader->NumBytesTotal() );
+    std::unique_ptr< SequenceReader< A > > dbReader( new FASTA::Reader< A >( db_table ) );
+    while( !dbReader->EndOfFile() ) {
+      Database< A > db( WordSize< A >::VALUE );
+      SetSeedMask( seedMask, &db );
+      SetMinimizerWindow( window, &db );
+      SetMaxKmerFrequency( maxKmerFrequency, &db );
+      db.SetDereplicate( dereplicate );
+      db.SetPositionalPostings( positional );
+      {
+        SequenceList< A > sequences;
+        ReadDatabase( *dbReader, shardSize, &sequences, progress );
+        IndexDatabase( sequences, &db, progress );
+      }
+      searchShard( db );
+    }
   }
 
-  // Index DB
-  Database< DNA > db( WordSize< DNA >::VALUE );
-  db.SetProgressCallback(
-                         [&]( typename Database< DNA >::ProgressType type, size_t num, size_t total ) {
-                           switch( type ) {
-                           case Database< DNA >::ProgressType::StatsCollection:
-                             progress.Activate( ProgressType::StatsDB )
-                               .Set( ProgressType::StatsDB, num, total );
-                             break;
-
-                           case Database< DNA >::ProgressType::Indexing:
-                             progress.Activate( ProgressType::IndexDB )
-                               .Set( ProgressType::IndexDB, num, total );
-                             break;
-
-                           default:
-                             break;
-                           }
-                         } );
-  db.Initialize( sequences );
-
-  // Read and process queries
-  const int numQueriesPerWorkItem = 64;
-  
-  SearchParams< DNA > searchParams;
+  progress.Activate( ProgressType::WriteHits );
+  auto writer = DetectFileFormatAndOpenHitWriter< A >( output_file, FileFormat::ALNOUT );
+  for( size_t i = 0; i < queries.size(); i++ ) {
+    if( !hits[ i ].empty() )
+      ( *writer ) << QueryHitsPair< A >( queries[ i ],
+                                         WithDuplicateHits( hits[ i ] ) );
+    progress.Set( ProgressType::WriteHits, i + 1, queries.size() );
+  }
 
-  searchParams.maxAccepts = maxAccepts;
-  searchParams.maxRejects = maxRejects;
-  searchParams.minIdentity = minIdentity;
+  Rcout << "\n";
+}
 
-  if (strand == "both") searchParams.strand = DNA::Strand::Both;
-  else if (strand == "plus") searchParams.strand = DNA::Strand::Plus;
-  else if (strand == "minus") searchParams.strand = DNA::Strand::Minus;
-  else stop("Strand must be 'plus', 'minus' or 'both'.");
+// Searches all queries against one database held in memory
+template < typename A >
+void SearchDatabase( const std::string& query_table, const Database< A >& db,
+                     const std::string&       output_file,
+                     const SearchParams< A >& searchParams,
+                     ProgressOutput&          progress ) {
+  const int numQueriesPerWorkItem = 64;
 
-  SearchResultsWriter< DNA >   writer( 1, output_file );
-  QueryDatabaseSearcher< DNA > searcher( -1, &writer, &db, searchParams );
+  SearchResultsWriter< A >   writer( 1, output_file );
+  QueryDatabaseSearcher< A > searcher( -1, &writer, &db, searchParams );
 
   searcher.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
                           progress.Set( ProgressType::SearchDB, numProcessed, numEnqueued );
@@ -219,9 +479,9 @@ void dna_blast(std::string query_table,
                         progress.Set( ProgressType::WriteHits, numProcessed, numEnqueued );
                       } );
 
-  std::unique_ptr< SequenceReader< DNA > > qryReader( new FASTA::Reader< DNA >( query_table ) );
+  std::unique_ptr< SequenceReader< A > > qryReader( new FASTA::Reader< A >( query_table ) );
 
-  SequenceList< DNA > queries;
+  SequenceList< A > queries;
   progress.Activate( ProgressType::ReadQueryFile );
   while( !qryReader->EndOfFile() ) {
     qryReader->Read( numQueriesPerWorkItem, &queries );
@@ -240,110 +500,284 @@ void dna_blast(std::string query_table,
   Rcout << "\n";
 }
 
+// Databases held by R between searches (blast_db), the R object owns
+// the database. The external pointer is tagged with the alphabet, so a
+// handle can't be taken for a database of another one.
+template < typename A >
+SEXP DatabaseHandleTag();
+
+template <>
+SEXP DatabaseHandleTag< DNA >() {
+  return Rf_install( "blaster_dna_db" );
+}
+
+template <>
+SEXP DatabaseHandleTag< Protein >() {
+  return Rf_install( "blaster_protein_db" );
+}
+
+template < typename A >
+SEXP NewDatabaseHandle( const std::string& db_table, const std::string& seedMask,
+                        const int window, const double maxKmerFrequency,
+                        const bool dereplicate, const bool positional ) {
+  ProgressOutput progress;
+  AddProgressStages( progress );
+
+  std::unique_ptr< Database< A > > db( new Database< A >( WordSize< A >::VALUE ) );
+  LoadDatabase( db_table, seedMask, window, maxKmerFrequency, dereplicate,
+                positional, db.get(), progress );
+
+  Rcout << "\n";
+
+  return XPtr< Database< A > >( db.release(), true, DatabaseHandleTag< A >() );
+}
+
+template < typename A >
+const Database< A >& DatabaseFromHandle( SEXP handle ) {
+  if( TYPEOF( handle ) != EXTPTRSXP ||
+      R_ExternalPtrTag( handle ) != DatabaseHandleTag< A >() )
+    stop( "Not a database of this alphabet, create it with blast_db()." );
+
+  XPtr< Database< A > > db( handle );
+  if( !db.get() )
+    stop( "The database is gone (e.g. the R session was restored), "
+          "create it again with blast_db()." );
+
+  return *db;
+}
+
+DNA::Strand ParseStrand( const std::string& strand ) {
+  if( strand == "both" ) return DNA::Strand::Both;
+  if( strand == "plus" ) return DNA::Strand::Plus;
+  if( strand == "minus" ) return DNA::Strand::Minus;
+  stop( "Strand must be 'plus', 'minus' or 'both'." );
+}
+
+std::string DFtoSeq(DataFrame seq_table)
+{
+  std::vector< std::string > ids = seq_table["Id"];
+  std::vector< std::string > seqs = seq_table["Seq"];
+  
+  std::stringstream content;
+
+  for (int i{0}; i < ids.size(); ++i) {
+    std::string id{ids[i]};
+    std::string seq{seqs[i]};
+    content << ">" << id << "\n" << seq << "\n";
+  }
+  return content.str();
+}
+
+
+// [[Rcpp::export]]
+void dna_blast(std::string query_table,
+               std::vector< std::string > db_tables,
+               std::string output_file,
+               int maxAccepts = 1,
+               int maxRejects =  16,
+               double minIdentity = 0.75,
+               std::string strand = "both",
+               std::string seedMask = "",
+               int window = 0,
+               double maxKmerFrequency = 0,
+               bool dereplicate = false,
+               bool positional = false,
+               double shardSize = 0) 
+{
+  SearchParams< DNA > searchParams;
+
+  searchParams.maxAccepts = maxAccepts;
+  searchParams.maxRejects = maxRejects;
+  searchParams.minIdentity = minIdentity;
+
+  searchParams.strand = ParseStrand( strand );
+
+  if (db_tables.empty()) stop("No database specified.");
+
+  if (db_tables.size() > 1 || ShardSize( shardSize ) > 0) {
+    SearchShards( query_table, db_tables, output_file, searchParams,
+                  seedMask, window, maxKmerFrequency, dereplicate,
+                  positional, ShardSize( shardSize ) );
+    return;
+  }
+
+  ProgressOutput progress;
+  AddProgressStages( progress );
+
+  // Read and index DB (or map a prebuilt index)
+  Database< DNA > db( WordSize< DNA >::VALUE );
+  LoadDatabase( db_tables.front(), seedMask, window, maxKmerFrequency,
+                dereplicate, positional, &db, progress );
+
+  SearchDatabase( query_table, db, output_file, searchParams, progress );
+}
+
 
 // [[Rcpp::export]]
 void protein_blast(std::string query_table,
-                   std::string db_table,
+                   std::vector< std::string > db_tables,
                    std::string output_file,
                    int maxAccepts = 1,
                    int maxRejects =  16,
-                   double minIdentity = 0.75) 
+                   double minIdentity = 0.75,
+                   std::string seedMask = "",
+                   int window = 0,
+                   double maxKmerFrequency = 0,
+                   bool dereplicate = false,
+                   bool positional = false,
+                   double shardSize = 0) 
 {
+  SearchParams< Protein > searchParams;
 
-  std::unique_ptr< SequenceReader< Protein > > dbReader( new FASTA::Reader< Protein >( db_table ) );
-  
-  Sequence< Protein > seq;
-  SequenceList< Protein > sequences;
+  searchParams.maxAccepts = maxAccepts;
+  searchParams.maxRejects = maxRejects;
+  searchParams.minIdentity = minIdentity;
 
-  while( !( dbReader->EndOfFile() ) ) {
-    ( *dbReader ) >> seq;
-    sequences.push_back( std::move( seq ) );
+  if (db_tables.empty()) stop("No database specified.");
+
+  if (db_tables.size() > 1 || ShardSize( shardSize ) > 0) {
+    SearchShards( query_table, db_tables, output_file, searchParams,
+                  seedMask, window, maxKmerFrequency, dereplicate,
+                  positional, ShardSize( shardSize ) );
+    return;
   }
 
   ProgressOutput progress;
+  AddProgressStages( progress );
 
-  enum ProgressType {
-                     ReadDBFile,
-                     StatsDB,
-                     IndexDB,
-                     ReadQueryFile,
-                     SearchDB,
-                     WriteHits
-  };
+  // Read and index DB (or map a prebuilt index)
+  Database< Protein > db( WordSize< Protein >::VALUE );
+  LoadDatabase( db_tables.front(), seedMask, window, maxKmerFrequency,
+                dereplicate, positional, &db, progress );
 
-  progress.Add( ProgressType::ReadDBFile, "Read database", UnitType::BYTES );
-  progress.Add( ProgressType::StatsDB, "Analyze database" );
-  progress.Add( ProgressType::IndexDB, "Index database" );
-  progress.Add( ProgressType::ReadQueryFile, "Read queries", UnitType::BYTES );
-  progress.Add( ProgressType::SearchDB, "Search database" );
-  progress.Add( ProgressType::WriteHits, "Write hits" );
+  SearchDatabase( query_table, db, output_file, searchParams, progress );
+}
 
-  // Read DB
-  progress.Activate( ProgressType::ReadDBFile );
-  while( !dbReader->EndOfFile() ) {
-    ( *dbReader ) >> seq;
-    sequences.push_back( std::move( seq ) );
-    progress.Set( ProgressType::ReadDBFile, dbReader->NumBytesRead(),
-                  dbReader->NumBytesTotal() );
-  }
 
-  // Index DB
-  Database< Protein > db( WordSize< Protein >::VALUE );
-  db.SetProgressCallback(
-                         [&]( typename Database< Protein >::ProgressType type, size_t num, size_t total ) {
-                           switch( type ) {
-                           case Database< Protein >::ProgressType::StatsCollection:
-                             progress.Activate( ProgressType::StatsDB )
-                               .Set( ProgressType::StatsDB, num, total );
-                             break;
-
-                           case Database< Protein >::ProgressType::Indexing:
-                             progress.Activate( ProgressType::IndexDB )
-                               .Set( ProgressType::IndexDB, num, total );
-                             break;
-
-                           default:
-                             break;
-                           }
-                         } );
-  db.Initialize( sequences );
-
-  // Read and process queries
-  const int numQueriesPerWorkItem = 64;
-  
-  SearchParams< Protein > searchParams;
+// [[Rcpp::export]]
+std::vector< std::string > build_dna_index(std::string db_table,
+                                           std::string index_file,
+                                           bool compress = false,
+                                           std::string seedMask = "",
+                                           int window = 0,
+                                           double maxKmerFrequency = 0,
+                                           bool dereplicate = false,
+                                           bool positional = false,
+                                           double shardSize = 0)
+{
+  return BuildIndex< DNA >( db_table, index_file, compress, seedMask, window,
+                            maxKmerFrequency, dereplicate, positional,
+                            ShardSize( shardSize ) );
+}
+
+
+// [[Rcpp::export]]
+std::vector< std::string > build_protein_index(std::string db_table,
+                                               std::string index_file,
+                                               bool compress = false,
+                                               std::string seedMask = "",
+                                               int window = 0,
+                                               double maxKmerFrequency = 0,
+                                               bool dereplicate = false,
+                                               bool positional = false,
+                                               double shardSize = 0)
+{
+  return BuildIndex< Protein >( db_table, index_file, compress, seedMask,
+                                window, maxKmerFrequency, dereplicate,
+                                positional, ShardSize( shardSize ) );
+}
+
+
+// [[Rcpp::export]]
+SEXP build_dna_db(std::string db_table,
+                  std::string seedMask = "",
+                  int window = 0,
+                  double maxKmerFrequency = 0,
+                  bool dereplicate = false,
+                  bool positional = false)
+{
+  return NewDatabaseHandle< DNA >( db_table, seedMask, window,
+                                   maxKmerFrequency, dereplicate, positional );
+}
+
+
+// [[Rcpp::export]]
+SEXP build_protein_db(std::string db_table,
+                      std::string seedMask = "",
+                      int window = 0,
+                      double maxKmerFrequency = 0,
+                      bool dereplicate = false,
+                      bool positional = false)
+{
+  return NewDatabaseHandle< Protein >( db_table, seedMask, window,
+                                       maxKmerFrequency, dereplicate,
+                                       positional );
+}
+
+
+// [[Rcpp::export]]
+void dna_blast_db(std::string query_table,
+                  SEXP db,
+                  std::string output_file,
+                  int maxAccepts = 1,
+                  int maxRejects =  16,
+                  double minIdentity = 0.75,
+                  std::string strand = "both",
+                  std::string seedMask = "",
+                  int window = 0,
+                  double maxKmerFrequency = 0,
+                  bool dereplicate = false,
+                  bool positional = false,
+                  double shardSize = 0)
+{
+  SearchParams< DNA > searchParams;
 
   searchParams.maxAccepts = maxAccepts;
   searchParams.maxRejects = maxRejects;
   searchParams.minIdentity = minIdentity;
+  searchParams.strand = ParseStrand( strand );
 
-  SearchResultsWriter< Protein >   writer( 1, output_file );
-  QueryDatabaseSearcher< Protein > searcher( -1, &writer, &db, searchParams );
+  const Database< DNA >& database = DatabaseFromHandle< DNA >( db );
+  CheckDatabaseOptions( database, seedMask, window, maxKmerFrequency,
+                        dereplicate, positional );
+  if( ShardSize( shardSize ) > 0 )
+    stop( "A database of blast_db() is searched whole." );
 
-  searcher.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
-                          progress.Set( ProgressType::SearchDB, numProcessed, numEnqueued );
-                        } );
-  writer.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
-                        progress.Set( ProgressType::WriteHits, numProcessed, numEnqueued );
-                      } );
+  ProgressOutput progress;
+  AddProgressStages( progress );
 
-  std::unique_ptr< SequenceReader< Protein > > qryReader( new FASTA::Reader< Protein >( query_table ) );
+  SearchDatabase( query_table, database, output_file, searchParams, progress );
+}
 
-  SequenceList< Protein > queries;
-  progress.Activate( ProgressType::ReadQueryFile );
-  while( !qryReader->EndOfFile() ) {
-    qryReader->Read( numQueriesPerWorkItem, &queries );
-    searcher.Enqueue( queries );
-    progress.Set( ProgressType::ReadQueryFile, qryReader->NumBytesRead(),
-                  qryReader->NumBytesTotal() );
-  }
 
-  // Search
-  progress.Activate( ProgressType::SearchDB );
-  searcher.WaitTillDone();
+// [[Rcpp::export]]
+void protein_blast_db(std::string query_table,
+                      SEXP db,
+                      std::string output_file,
+                      int maxAccepts = 1,
+                      int maxRejects =  16,
+                      double minIdentity = 0.75,
+                      std::string seedMask = "",
+                      int window = 0,
+                      double maxKmerFrequency = 0,
+                      bool dereplicate = false,
+                      bool positional = false,
+                      double shardSize = 0)
+{
+  SearchParams< Protein > searchParams;
 
-  progress.Activate( ProgressType::WriteHits );
-  writer.WaitTillDone();
+  searchParams.maxAccepts = maxAccepts;
+  searchParams.maxRejects = maxRejects;
+  searchParams.minIdentity = minIdentity;
 
-  Rcout << "\n";
+  const Database< Protein >& database = DatabaseFromHandle< Protein >( db );
+  CheckDatabaseOptions( database, seedMask, window, maxKmerFrequency,
+                        dereplicate, positional );
+  if( ShardSize( shardSize ) > 0 )
+    stop( "A database of blast_db() is searched whole." );
+
+  ProgressOutput progress;
+  AddProgressStages( progress );
+
+  SearchDatabase( query_table, database, output_file, searchParams, progress );
 }
@@ -0,0 +1,103 @@
+// Size of the posting lists (sequence ids and their offsets) and how fast
+// the hits of the queries are counted from them, plain or delta + varint
+// encoded. Built and run by postings.R, and with 16-bit sequence ids
+// (postings16.cpp).
+#include <Rcpp.h>
+
+// [[Rcpp::plugins(cpp11)]]
+
+#include "../../src/Alphabet/DNA.h"
+#include "../../src/Alphabet/Protein.h"
+#include "../../src/Database.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+// SectionSequenceIds and SectionSequenceIdsOffsetByKmer of Database
+const size_t PostingSections[] = { 4, 5 };
+
+template < typename Alphabet >
+SequenceList< Alphabet > ToSequences( const std::vector< std::string >& seqs ) {
+  SequenceList< Alphabet > list;
+  for( size_t i = 0; i < seqs.size(); i++ )
+    list.push_back( Sequence< Alphabet >( std::to_string( i ), seqs[ i ] ) );
+  return list;
+}
+
+template < typename Alphabet >
+Rcpp::DataFrame Bench( const std::string& alphabet, const size_t kmerLength,
+                       const std::vector< std::string >& db,
+                       const std::vector< std::string >& queries,
+                       const bool compress, const std::string& indexFile,
+                       const int rounds ) {
+  Database< Alphabet > database( kmerLength );
+  database.SetCompressSequenceIds( compress );
+  database.Initialize( ToSequences< Alphabet >( db ) );
+
+  database.Save( indexFile );
+  double postingsBytes = 0;
+  {
+    Index::Reader reader( indexFile );
+    for( auto section : PostingSections )
+      postingsBytes += reader.GetHeader().sections[ section ].size;
+  }
+
+  // Every distinct kmer of a query counts a hit for each sequence it is
+  // found in
+  auto                     qs = ToSequences< Alphabet >( queries );
+  std::vector< uint16_t >  hits( database.NumSequences() );
+  std::vector< bool >      unique( database.MaxUniqueKmers() );
+  std::vector< Kmer >      kmers;
+  size_t                   numPostings = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for( int round = 0; round < rounds; round++ ) {
+    for( auto& query : qs ) {
+      std::fill( hits.begin(), hits.end(), 0 );
+      kmers.clear();
+      Kmers< Alphabet >( query, database.GetSeedMask() )
+        .ForEach( [&]( const Kmer kmer, const size_t ) {
+          if( kmer != AmbiguousKmer && !unique[ kmer ] ) {
+            unique[ kmer ] = true;
+            kmers.push_back( kmer );
+          }
+        } );
+
+      for( auto kmer : kmers ) {
+        database.ForEachSequenceIdIncludingKmer(
+          kmer, [&]( const SequenceId seqId ) {
+            hits[ seqId ]++;
+            numPostings++;
+          } );
+        unique[ kmer ] = false;
+      }
+    }
+  }
+  double elapsed = std::chrono::duration< double >(
+                     std::chrono::steady_clock::now() - start )
+                     .count();
+
+  return Rcpp::DataFrame::create(
+    Rcpp::Named( "alphabet" ) = alphabet,
+    Rcpp::Named( "id_bits" ) = int( 8 * sizeof( SequenceId ) ),
+    Rcpp::Named( "compressed" ) = compress,
+    Rcpp::Named( "postings_mb" ) = postingsBytes / ( 1024 * 1024 ),
+    Rcpp::Named( "mpostings_per_s" ) = numPostings / elapsed / 1e6 );
+}
+
+} // namespace
+
+// [[Rcpp::export]]
+Rcpp::DataFrame bench_postings( const std::string&                alphabet,
+                                const std::vector< std::string >& db,
+                                const std::vector< std::string >& queries,
+                                const bool                        compress,
+                                const std::string&                indexFile,
+                                const int                         rounds ) {
+  if( alphabet == "protein" )
+    return Bench< Protein >( alphabet, 5, db, queries, compress, indexFile, rounds );
+  return Bench< DNA >( alphabet, 8, db, queries, compress, indexFile, rounds );
+}
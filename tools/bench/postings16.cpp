@@ -0,0 +1,12 @@
+// postings.cpp with 16-bit sequence ids
+#define USE_16BIT_SEQUENCE_IDS
+#include "postings.cpp"
+
+// [[Rcpp::export]]
+Rcpp::DataFrame bench_postings_16bit( const std::string&                alphabet,
+                                      const std::vector< std::string >& db,
+                                      const std::vector< std::string >& queries,
+                                      const std::string& indexFile,
+                                      const int          rounds ) {
+  return bench_postings( alphabet, db, queries, false, indexFile, rounds );
+}
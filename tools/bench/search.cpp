@@ -0,0 +1,148 @@
+// Nucleotide searches (GlobalSearch, one thread): heap allocations and
+// microseconds per query on a second pass over the queries, and per-query
+// against batched searching. Built and run by search.R.
+#include <Rcpp.h>
+
+// [[Rcpp::plugins(cpp11)]]
+
+#include "../../src/Alphabet/DNA.h"
+#include "../../src/Database/GlobalSearch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Allocations are counted by replacing operator new for this library
+static size_t gNumAllocations = 0;
+
+void* operator new( size_t size ) {
+  gNumAllocations++;
+  if( void* ptr = malloc( size ) )
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete( void* ptr ) noexcept {
+  free( ptr );
+}
+
+void operator delete( void* ptr, size_t ) noexcept {
+  free( ptr );
+}
+
+namespace {
+
+double Now() {
+  return std::chrono::duration< double >(
+           std::chrono::steady_clock::now().time_since_epoch() )
+    .count();
+}
+
+SequenceList< DNA > ToSequences( const std::vector< std::string >& seqs ) {
+  SequenceList< DNA > list;
+  for( size_t i = 0; i < seqs.size(); i++ )
+    list.push_back( Sequence< DNA >( std::to_string( i ), seqs[ i ] ) );
+  return list;
+}
+
+// SearchForHits on its own, without collecting the hits
+class HitCounter : public GlobalSearch< DNA > {
+public:
+  using GlobalSearch< DNA >::GlobalSearch;
+
+  size_t CountHits( const Sequence< DNA >& query ) {
+    size_t numHits = 0;
+    SearchForHits( query, [&]( const SequenceId, const Sequence< DNA >&,
+                               const Cigar& ) { numHits++; } );
+    return numHits;
+  }
+};
+
+} // namespace
+
+// [[Rcpp::export]]
+Rcpp::DataFrame bench_search_allocations( const std::vector< std::string >& db,
+                                          const std::vector< std::string >& queries,
+                                          const int    kmerLength,
+                                          const double minIdentity ) {
+  Database< DNA > database( kmerLength );
+  database.Initialize( ToSequences( db ) );
+
+  SearchParams< DNA > params;
+  params.minIdentity = minIdentity;
+  HitCounter search( database, params );
+
+  // The first pass grows the buffers the search keeps
+  auto   qs     = ToSequences( queries );
+  size_t before = gNumAllocations;
+  for( auto& query : qs )
+    search.CountHits( query );
+  if( gNumAllocations == before )
+    Rcpp::stop( "operator new is not replaced, allocations can't be counted" );
+
+  size_t numHits = 0;
+  before         = gNumAllocations;
+  double start   = Now();
+  for( auto& query : qs )
+    numHits += search.CountHits( query );
+  double elapsed        = Now() - start;
+  size_t numAllocations = gNumAllocations - before;
+
+  return Rcpp::DataFrame::create(
+    Rcpp::Named( "sequences" ) = int( db.size() ),
+    Rcpp::Named( "queries" ) = int( qs.size() ),
+    Rcpp::Named( "hits" ) = int( numHits ),
+    Rcpp::Named( "allocs_per_query" ) = double( numAllocations ) / qs.size(),
+    Rcpp::Named( "us_per_query" ) = 1e6 * elapsed / qs.size() );
+}
+
+// Work items of 64 queries, as the searcher workers take them
+// [[Rcpp::export]]
+Rcpp::DataFrame bench_search_batched( const std::vector< std::string >& db,
+                                      const std::vector< std::string >& queries,
+                                      const std::string& strand,
+                                      const int          rounds ) {
+  Database< DNA > database( 8 );
+  database.Initialize( ToSequences( db ) );
+
+  SearchParams< DNA > params;
+  params.strand = strand == "both" ? DNA::Strand::Both : DNA::Strand::Plus;
+  GlobalSearch< DNA > search( database, params );
+
+  auto                               qs = ToSequences( queries );
+  std::vector< SequenceList< DNA > > items;
+  for( size_t i = 0; i < qs.size(); i += 64 ) {
+    items.emplace_back( qs.begin() + i,
+                        qs.begin() + std::min( i + 64, qs.size() ) );
+  }
+
+  // Best of the rounds
+  double perQuery = 1e9, batched = 1e9;
+  size_t perQueryHits = 0, batchedHits = 0;
+  for( int round = 0; round < rounds; round++ ) {
+    perQueryHits = batchedHits = 0;
+
+    double start = Now();
+    for( auto& query : qs )
+      perQueryHits += search.Query( query ).size();
+    perQuery = std::min( perQuery, Now() - start );
+
+    start = Now();
+    for( auto& item : items ) {
+      for( auto& hits : search.Query( item ) )
+        batchedHits += hits.size();
+    }
+    batched = std::min( batched, Now() - start );
+  }
+
+  return Rcpp::DataFrame::create(
+    Rcpp::Named( "sequences" ) = int( db.size() ),
+    Rcpp::Named( "queries" ) = int( qs.size() ),
+    Rcpp::Named( "strand" ) = strand,
+    Rcpp::Named( "per_query_us" ) = 1e6 * perQuery / qs.size(),
+    Rcpp::Named( "batched_us" ) = 1e6 * batched / qs.size(),
+    Rcpp::Named( "same_hits" ) = perQueryHits == batchedHits );
+}
@@ -0,0 +1,117 @@
+// Seed finding per candidate: the query's kmer table built, then the
+// candidate's kmers joined against it (as GlobalSearch does), and the nested
+// loop over the kmers of both it replaced. Built and run by seeds.R.
+#include <Rcpp.h>
+
+// [[Rcpp::plugins(cpp11)]]
+
+#include "../../src/Alphabet/DNA.h"
+#include "../../src/Database/Seeds.h"
+
+#include "synthetic.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+double Now() {
+  return std::chrono::duration< double >(
+           std::chrono::steady_clock::now().time_since_epoch() )
+    .count();
+}
+
+std::vector< Kmer > KmersOf( const std::string& seq, const SeedMask& mask ) {
+  std::vector< Kmer > kmers;
+  Kmers< DNA >( Sequence< DNA >( seq ), mask )
+    .ForEach( [&]( const Kmer kmer, const size_t ) { kmers.push_back( kmer ); } );
+  return kmers;
+}
+
+bool SameSegmentPairs( const std::vector< HSP >& a, const std::vector< HSP >& b ) {
+  if( a.size() != b.size() )
+    return false;
+  for( size_t i = 0; i < a.size(); i++ ) {
+    if( a[ i ].a1 != b[ i ].a1 || a[ i ].a2 != b[ i ].a2 ||
+        a[ i ].b1 != b[ i ].b1 || a[ i ].b2 != b[ i ].b2 )
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// [[Rcpp::export]]
+Rcpp::DataFrame bench_seeds( const std::vector< int >& lengths,
+                             const double substitutions, const int kmerLength,
+                             const double seconds ) {
+  SeedMask     mask( kmerLength );
+  std::mt19937 rng( 14 );
+
+  std::vector< double > nestedColumn, tableColumn, joinColumn, pairsColumn;
+  std::vector< bool >   identicalColumn;
+
+  for( auto length : lengths ) {
+    std::string target = synthetic::RandomSequence( synthetic::Nucleotides,
+                                                    length, rng );
+    std::string query  = synthetic::Substitute(
+      target, synthetic::Nucleotides, substitutions, std::set< size_t >(), rng );
+    std::vector< Kmer > queryKmers  = KmersOf( query, mask );
+    std::vector< Kmer > targetKmers = KmersOf( target, mask );
+
+    Seeds              seeds;
+    QueryKmerTable     table;
+    std::vector< HSP > nested, joined;
+
+    // Each step is repeated for at least the given time
+    auto timed = [&]( const std::function< void() >& step ) {
+      size_t n     = 0;
+      double start = Now(), elapsed;
+      do {
+        step();
+        n++;
+        elapsed = Now() - start;
+      } while( elapsed < seconds );
+      return elapsed / n;
+    };
+
+    double nestedTime = timed( [&]() {
+      seeds.Clear();
+      for( size_t a = 0; a < queryKmers.size(); a++ ) {
+        if( queryKmers[ a ] == AmbiguousKmer )
+          continue;
+        for( size_t b = 0; b < targetKmers.size(); b++ ) {
+          if( targetKmers[ b ] == queryKmers[ a ] )
+            seeds.Add( a, b );
+        }
+      }
+      seeds.ToSegmentPairs( 1, &nested );
+    } );
+    double tableTime = timed( [&]() {
+      table.Assign( queryKmers.data(), queryKmers.size() );
+    } );
+    double joinTime = timed( [&]() {
+      seeds.Clear();
+      seeds.AddMatches( table, targetKmers.data(), targetKmers.size() );
+      seeds.ToSegmentPairs( 1, &joined );
+    } );
+
+    nestedColumn.push_back( 1e3 * nestedTime );
+    tableColumn.push_back( 1e3 * tableTime );
+    joinColumn.push_back( 1e3 * joinTime );
+    pairsColumn.push_back( joined.size() );
+    identicalColumn.push_back( SameSegmentPairs( nested, joined ) );
+  }
+
+  return Rcpp::DataFrame::create(
+    Rcpp::Named( "length" ) = lengths,
+    Rcpp::Named( "nested_ms" ) = nestedColumn,
+    Rcpp::Named( "table_ms" ) = tableColumn,
+    Rcpp::Named( "join_ms" ) = joinColumn,
+    Rcpp::Named( "segment_pairs" ) = pairsColumn,
+    Rcpp::Named( "identical" ) = identicalColumn );
+}
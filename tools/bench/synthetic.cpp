@@ -0,0 +1,31 @@
+// Inputs of the benchmarks (see synthetic.h), as character vectors
+#include <Rcpp.h>
+
+// [[Rcpp::plugins(cpp11)]]
+
+#include "synthetic.h"
+
+// [[Rcpp::export]]
+std::vector< std::string > synthetic_random( const std::string& alphabet,
+                                             const int          numSequences,
+                                             const int          length,
+                                             const int          seed ) {
+  return synthetic::RandomSequences( alphabet, numSequences, length, seed );
+}
+
+// [[Rcpp::export]]
+std::vector< std::string >
+synthetic_mutants( const std::string&                alphabet,
+                   const std::vector< std::string >& templates,
+                   const int numSequences, const double minDivergence,
+                   const double maxDivergence, const int seed ) {
+  return synthetic::Mutants( alphabet, templates, numSequences, minDivergence,
+                             maxDivergence, seed );
+}
+
+// [[Rcpp::export]]
+std::vector< std::string > synthetic_amplicons( const int    numSequences,
+                                                const double rate,
+                                                const int    seed ) {
+  return synthetic::Amplicons( numSequences, rate, seed );
+}
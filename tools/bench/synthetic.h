@@ -0,0 +1,123 @@
+// Synthetic sequences the benchmarks run on. Everything is drawn from
+// seeded generators, so a given call returns the same sequences on every
+// machine.
+#pragma once
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace synthetic {
+
+const std::string Nucleotides = "ACGT";
+const std::string AminoAcids  = "ACDEFGHIKLMNPQRSTVWY";
+
+inline const std::string& Letters( const std::string& alphabet ) {
+  return alphabet == "protein" ? AminoAcids : Nucleotides;
+}
+
+inline std::string RandomSequence( const std::string& letters,
+                                   const size_t length, std::mt19937& rng ) {
+  std::string seq;
+  for( size_t i = 0; i < length; i++ )
+    seq += letters[ rng() % letters.size() ];
+  return seq;
+}
+
+// Of divergence, 70% substitutions, 15% deletions and 15% insertions
+inline std::string Mutate( const std::string& seq, const std::string& letters,
+                           const double divergence, std::mt19937& rng ) {
+  std::uniform_real_distribution< double > uniform( 0.0, 1.0 );
+  std::string                              mutated;
+  for( auto letter : seq ) {
+    double r = uniform( rng );
+    if( r < 0.7 * divergence ) {
+      mutated += letters[ rng() % letters.size() ];
+    } else if( r < 0.85 * divergence ) {
+      continue;
+    } else if( r < divergence ) {
+      mutated += letter;
+      mutated += letters[ rng() % letters.size() ];
+    } else {
+      mutated += letter;
+    }
+  }
+  return mutated;
+}
+
+// Substitutions only, except at the kept positions
+inline std::string Substitute( const std::string& seq,
+                               const std::string& letters, const double rate,
+                               const std::set< size_t >& keep,
+                               std::mt19937&             rng ) {
+  std::uniform_real_distribution< double > uniform( 0.0, 1.0 );
+  std::string                              mutated = seq;
+  for( size_t i = 0; i < mutated.size(); i++ ) {
+    if( !keep.count( i ) && uniform( rng ) < rate )
+      mutated[ i ] = letters[ rng() % letters.size() ];
+  }
+  return mutated;
+}
+
+inline std::vector< std::string > RandomSequences( const std::string& alphabet,
+                                                   const size_t numSequences,
+                                                   const size_t length,
+                                                   const unsigned seed ) {
+  std::mt19937               rng( seed );
+  std::vector< std::string > seqs;
+  for( size_t i = 0; i < numSequences; i++ )
+    seqs.push_back( RandomSequence( Letters( alphabet ), length, rng ) );
+  return seqs;
+}
+
+// Copies of randomly picked templates, each mutated by a divergence drawn
+// uniformly from [ minDivergence, maxDivergence ]
+inline std::vector< std::string >
+Mutants( const std::string& alphabet, const std::vector< std::string >& templates,
+         const size_t numSequences, const double minDivergence,
+         const double maxDivergence, const unsigned seed ) {
+  std::mt19937                             rng( seed );
+  std::uniform_real_distribution< double > divergence( minDivergence,
+                                                       maxDivergence );
+  std::vector< std::string >               seqs;
+  for( size_t i = 0; i < numSequences; i++ ) {
+    const std::string& tmpl = templates[ rng() % templates.size() ];
+    seqs.push_back( Mutate( tmpl, Letters( alphabet ), divergence( rng ), rng ) );
+  }
+  return seqs;
+}
+
+// Amplicons of 250 nt: 800 taxa, 25% apart except at the primer sites and
+// two more conserved blocks. Every amplicon is a copy of a random taxon
+// with the given rate of substitutions.
+inline std::vector< std::string > Amplicons( const size_t numSequences,
+                                             const double rate,
+                                             const unsigned seed ) {
+  const size_t     length = 250;
+  std::set< size_t > conserved;
+  for( size_t i = 0; i < 20; i++ ) {
+    conserved.insert( i );
+    conserved.insert( length - 20 + i );
+  }
+  for( size_t i = 60; i < 85; i++ )
+    conserved.insert( i );
+  for( size_t i = 150; i < 170; i++ )
+    conserved.insert( i );
+
+  std::mt19937               taxaRng( 7 );
+  std::string                tmpl = RandomSequence( Nucleotides, length, taxaRng );
+  std::vector< std::string > taxa;
+  for( size_t i = 0; i < 800; i++ )
+    taxa.push_back( Substitute( tmpl, Nucleotides, 0.25, conserved, taxaRng ) );
+
+  std::mt19937               rng( seed );
+  std::vector< std::string > seqs;
+  for( size_t i = 0; i < numSequences; i++ ) {
+    const std::string& taxon = taxa[ rng() % taxa.size() ];
+    seqs.push_back( Substitute( taxon, Nucleotides, rate, conserved, rng ) );
+  }
+  return seqs;
+}
+
+} // namespace synthetic